@@ -0,0 +1,213 @@
+#include <stdexcept>
+#include <random>
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+
+#include "graph.hh"
+#include "profiler.hh"
+#include "options.hh"
+
+using namespace std;
+
+void bench( int argc, char *argv[] );
+
+int main( int argc, char *argv[] )
+{
+  try {
+    bench( argc, argv );
+  } catch ( exception & e ) {
+    cerr << "Died on exception: " << e.what() << endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
+
+static void usage( const char * argv0 )
+{
+  cerr << "Usage: " << argv0 << " [--rate=POINTS_PER_SECOND] [--window=SECONDS] [--size=WIDTHxHEIGHT]"
+       << " [--frames=N] [--line-mode=immediate|streaming|instanced] [--sync] [--onscreen]"
+       << " [--no-decimation] [--series=N] [--overlay-threads=N] [--sdf-text]" << endl
+       << "       [--stats-csv=FILE] [--antialiasing=multisample|analytic]" << endl;
+  throw runtime_error( "bad command-line arguments" );
+}
+
+static pair<unsigned int, unsigned int> parse_size( const string & value, const char * argv0 )
+{
+  const size_t x = value.find( 'x' );
+  if ( x == string::npos ) {
+    usage( argv0 );
+  }
+
+  return make_pair( stoul( value.substr( 0, x ) ), stoul( value.substr( x + 1 ) ) );
+}
+
+static void print_row( const string & name, const double p50, const double p90,
+		       const double p99, const double max )
+{
+  cout << setw( 18 ) << left << name << right << fixed << setprecision( 3 )
+       << setw( 10 ) << p50 * 1000 << setw( 10 ) << p90 * 1000
+       << setw( 10 ) << p99 * 1000 << setw( 10 ) << max * 1000 << endl;
+}
+
+void bench( int argc, char *argv[] )
+{
+  if ( argc < 1 ) {
+    throw runtime_error( "missing argv[ 0 ]" );
+  }
+
+  double rate = 1000;
+  float window = 3;
+  pair<unsigned int, unsigned int> size( 1024, 768 );
+  unsigned long frame_limit = 600;
+  Display::LineMode line_mode = Display::LineMode::Instanced;
+  bool synchronous = false;
+  bool offscreen = true;
+  bool decimation = true;
+  unsigned int series = 1;
+  unsigned int overlay_threads = 1;
+  bool sdf_text = false;
+  string stats_csv;
+  Display::Antialiasing antialiasing = Display::Antialiasing::Multisample;
+
+  for ( int i = 1; i < argc; i++ ) {
+    const string arg = argv[ i ];
+    string value;
+
+    if ( option_value( arg, "--rate", value ) ) {
+      rate = stod( value );
+    } else if ( option_value( arg, "--window", value ) ) {
+      window = stof( value );
+    } else if ( option_value( arg, "--size", value ) ) {
+      size = parse_size( value, argv[ 0 ] );
+    } else if ( option_value( arg, "--frames", value ) ) {
+      frame_limit = stoul( value );
+    } else if ( option_value( arg, "--line-mode", value ) ) {
+      if ( not parse_line_mode( value, line_mode ) ) {
+	usage( argv[ 0 ] );
+      }
+    } else if ( arg == "--sync" ) {
+      synchronous = true;
+    } else if ( arg == "--onscreen" ) {
+      offscreen = false;
+    } else if ( arg == "--no-decimation" ) {
+      decimation = false;
+    } else if ( option_value( arg, "--series", value ) ) {
+      series = stoul( value );
+    } else if ( option_value( arg, "--overlay-threads", value ) ) {
+      overlay_threads = stoul( value );
+    } else if ( arg == "--sdf-text" ) {
+      sdf_text = true;
+    } else if ( option_value( arg, "--stats-csv", value ) ) {
+      stats_csv = value;
+    } else if ( option_value( arg, "--antialiasing", value ) ) {
+      if ( not parse_antialiasing( value, antialiasing ) ) {
+	usage( argv[ 0 ] );
+      }
+    } else {
+      usage( argv[ 0 ] );
+    }
+  }
+
+  /* analytic antialiasing is only drawn in instanced mode, so don't let it pass for another */
+  if ( rate <= 0 or window <= 0 or frame_limit == 0 or series == 0 or overlay_threads == 0
+       or (antialiasing == Display::Antialiasing::Analytic and line_mode != Display::LineMode::Instanced) ) {
+    usage( argv[ 0 ] );
+  }
+
+  /* the graph keeps a second of slack on either side of the window */
+  const size_t capacity = size_t( rate * (window + 2) ) + 2;
+
+  Graph graph( size.first, size.second, "glfun-bench", capacity, offscreen, antialiasing );
+  graph.set_line_mode( line_mode );
+  graph.set_synchronous_swap( synchronous );
+  graph.set_decimation( decimation );
+  graph.set_overlay_threads( overlay_threads );
+  graph.set_sdf_text( sdf_text );
+
+  /* the first series is the graph's own */
+  for ( unsigned int i = 1; i < series; i++ ) {
+    graph.add_series();
+  }
+
+  Profiler profiler;
+  graph.set_profiler( &profiler );
+
+  /* a simulated 60 Hz clock, so every run feeds the graph the same number of points */
+  const double frame_interval = 1.0 / 60.0;
+  const double point_interval = 1.0 / rate;
+
+  default_random_engine prng;
+  normal_distribution<float> step( 0, 1 );
+
+  double next_point = 0;
+  vector<float> values( series );
+
+  const auto start_time = chrono::steady_clock::now();
+  unsigned long frames = 0;
+  GLState::Counters gl_state = { 0, 0, 0, 0 };
+
+  while ( frames < frame_limit ) {
+    const double t = (frames + 1) * frame_interval;
+
+    for ( ; next_point <= t; next_point += point_interval ) {
+      for ( unsigned int i = 0; i < series; i++ ) {
+	values[ i ] += step( prng );
+	graph.add_data_point( i, next_point, values[ i ] );
+      }
+    }
+
+    graph.set_window( t, window );
+
+    frames++;
+
+    const bool quit = graph.blocking_draw( t, window );
+
+    gl_state.calls += GLState::last_frame().calls;
+    gl_state.elided += GLState::last_frame().elided;
+
+    if ( quit ) {
+      break;
+    }
+  }
+
+  const chrono::duration<double> elapsed = chrono::steady_clock::now() - start_time;
+
+  cout << frames << " frames of " << size.first << "x" << size.second << ", " << series << " series of "
+       << rate << " points/s over a " << window << " s window, in "
+       << elapsed.count() << " s (" << frames / elapsed.count() << " frames/s), "
+       << line_mode_name( line_mode ) << " lines with "
+       << (antialiasing == Display::Antialiasing::Analytic ? "analytic antialiasing" : "4x multisampling") << endl;
+
+  cout << "GL binds and lookups per frame: " << double( gl_state.calls ) / frames << " made, "
+       << double( gl_state.elided ) / frames << " skipped" << endl;
+
+  cout << setw( 18 ) << left << "stage (ms)" << right
+       << setw( 10 ) << "p50" << setw( 10 ) << "p90" << setw( 10 ) << "p99" << setw( 10 ) << "max" << endl;
+
+  for ( unsigned int i = 0; i < Profiler::stage_count; i++ ) {
+    const auto stage = static_cast<Profiler::Stage>( i );
+    print_row( Profiler::name( stage ),
+	       profiler.percentile( stage, 0.5 ), profiler.percentile( stage, 0.9 ),
+	       profiler.percentile( stage, 0.99 ), profiler.percentile( stage, 1.0 ) );
+  }
+
+  print_row( "total",
+	     profiler.total_percentile( 0.5 ), profiler.total_percentile( 0.9 ),
+	     profiler.total_percentile( 0.99 ), profiler.total_percentile( 1.0 ) );
+
+  for ( unsigned int i = 0; i < Profiler::gpu_pass_count; i++ ) {
+    const auto pass = static_cast<Profiler::GpuPass>( i );
+    print_row( string( "GPU " ) + Profiler::name( pass ),
+	       profiler.gpu_percentile( pass, 0.5 ), profiler.gpu_percentile( pass, 0.9 ),
+	       profiler.gpu_percentile( pass, 0.99 ), profiler.gpu_percentile( pass, 1.0 ) );
+  }
+
+  cout << "per frame: " << setprecision( 0 ) << profiler.mean_vertices() << " vertices submitted, "
+       << setprecision( 1 ) << profiler.mean_uploaded() / 1024 << " kB uploaded" << endl;
+
+  if ( not stats_csv.empty() ) {
+    profiler.write_csv( stats_csv );
+  }
+}
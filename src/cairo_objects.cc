@@ -22,11 +22,39 @@ Cairo::Cairo( const pair<unsigned int, unsigned int> size )
 	    size.second,
 	    stride_pixels_for_width( size.first ) ),
     surface_( image_ ),
-    context_( surface_ )
+    context_( surface_ ),
+    origin_( 0, 0 )
 {
   check_error();
 }
 
+Cairo::Cairo( const pair<unsigned int, unsigned int> size, Pixel * const external_pixels,
+	      const pair<unsigned int, unsigned int> origin )
+  : image_( size.first,
+	    size.second,
+	    stride_pixels_for_width( size.first ),
+	    external_pixels ),
+    surface_( image_ ),
+    context_( surface_ ),
+    origin_( origin )
+{
+  identity_matrix();
+  check_error();
+}
+
+void Cairo::identity_matrix( void )
+{
+  cairo_identity_matrix( *this );
+  cairo_translate( *this, -double( origin_.first ), -double( origin_.second ) );
+}
+
+void Cairo::finish( void )
+{
+  cairo_surface_flush( surface_.surface.get() );
+  cairo_surface_finish( surface_.surface.get() );
+  check_error();
+}
+
 Cairo::Surface::Surface( Image & image )
   : surface( cairo_image_surface_create_for_data( image.raw_pixels(),
 						  CAIRO_FORMAT_ARGB32,
@@ -71,7 +99,8 @@ Pango::Pango( Cairo & cairo )
 {}
 
 Pango::Font::Font( const string & description )
-  : font( pango_font_description_from_string( description.c_str() ) )
+  : description( description ),
+    font( pango_font_description_from_string( description.c_str() ) )
 {}
 
 void Pango::set_font( const Pango::Font & font )
@@ -109,8 +138,9 @@ void Pango::Text::draw_centered_at( Cairo & cairo, const double x, const double
   cairo_new_path( cairo );
   Cairo::Extent<true> my_extent = extent().to_device( cairo );
 
-  double center_x = x - my_extent.x - my_extent.width / 2;
-  double center_y = y - my_extent.y - my_extent.height / 2;
+  /* (x, y) is in the whole image; the surface may be a band of it */
+  double center_x = x - cairo.origin().first - my_extent.x - my_extent.width / 2;
+  double center_y = y - cairo.origin().second - my_extent.y - my_extent.height / 2;
 
   cairo_device_to_user( cairo, &center_x, &center_y );
   cairo_translate( cairo, center_x, center_y );
@@ -126,8 +156,8 @@ void Pango::Text::draw_centered_rotated_at( Cairo & cairo, const double x, const
 
   Cairo::Extent<true> my_extent = extent().to_device( cairo );
 
-  double center_x = x - my_extent.x - my_extent.width / 2;
-  double center_y = y - my_extent.y - my_extent.height / 2;
+  double center_x = x - cairo.origin().first - my_extent.x - my_extent.width / 2;
+  double center_y = y - cairo.origin().second - my_extent.y - my_extent.height / 2;
 
   cairo_device_to_user( cairo, &center_x, &center_y );
   cairo_translate( cairo, center_x, center_y );
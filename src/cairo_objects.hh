@@ -4,6 +4,7 @@
 #include <cairo.h>
 #include <pango/pangocairo.h>
 #include <memory>
+#include <string>
 
 #include "image.hh"
 
@@ -33,14 +34,31 @@ class Cairo
     void check_error( void );
   } context_;
 
-  static int stride_pixels_for_width( const unsigned int width );
+  /* where this surface's top-left pixel sits in the larger image it is part of */
+  std::pair<unsigned int, unsigned int> origin_;
+
   void check_error( void );
 
 public:
   Cairo( const std::pair<unsigned int, unsigned int> size );
 
+  /* draw into external memory of at least stride_pixels_for_width( width ) * height pixels,
+     which may be a band of a larger image starting at origin */
+  Cairo( const std::pair<unsigned int, unsigned int> size, Pixel * const external_pixels,
+	 const std::pair<unsigned int, unsigned int> origin = std::make_pair( 0, 0 ) );
+
+  static int stride_pixels_for_width( const unsigned int width );
+
+  /* flush drawing to memory and detach the surface from it */
+  void finish( void );
+
   operator cairo_t * () { return context_.context.get(); }
 
+  const std::pair<unsigned int, unsigned int> & origin( void ) const { return origin_; }
+
+  /* user coordinates are those of the whole image (the identity unless this is a band) */
+  void identity_matrix( void );
+
   Image & mutable_image( void ) { return image_; }
   const Image & image( void ) const { return image_; }
 
@@ -107,6 +125,7 @@ public:
   {
     struct Deleter { void operator() ( PangoFontDescription * x ) { pango_font_description_free( x ); } };
 
+    std::string description;
     std::unique_ptr<PangoFontDescription, Deleter> font;
 
     Font( const std::string & description );
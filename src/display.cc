@@ -3,7 +3,15 @@
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 
+#include <cstddef>
+#include <cmath>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
 #include "display.hh"
+#include "image.hh"
+#include "video_writer.hh"
 
 using namespace std;
 
@@ -22,17 +30,175 @@ const std::string Display::shader_source_scale_from_pixel_coordinates
       }
     )";
 
+const std::string Display::shader_source_scale_from_data_coordinates
+= R"( #version 140
+
+      uniform uvec2 window_size;
+      uniform vec2 scale;
+      uniform vec2 offset;
+      uniform float halfwidth;
+      in float t;
+      in float y;
+      in vec2 pixel_offset; /* in units of halfwidth */
+      out vec2 raw_position;
+
+      void main()
+      {
+        vec2 pixel = vec2( t, y ) * scale + offset + pixel_offset * halfwidth;
+	gl_Position = vec4( 2 * pixel.x / window_size.x - 1.0,
+                            1.0 - 2 * pixel.y / window_size.y, 0.0, 1.0 );
+        raw_position = pixel;
+      }
+    )";
+
+const std::string Display::shader_source_step_segment_instance
+= R"( #version 140
+
+      uniform uvec2 window_size;
+      uniform vec2 scale;
+      uniform vec2 offset;
+      uniform float halfwidth;
+      uniform float feather;
+
+      in float start_t;
+      in float start_y;
+      in float end_t;
+      in float end_y;
+
+      out vec2 raw_position;
+      out vec2 edge_offset;
+      flat out float edge_halfwidth;
+
+      /* for each of the 18 vertices: (use end time?, use end value?, offset x, offset y).
+         0-5 are the horizontal quad, 6-11 the vertical quad (offsets in units of
+         the signed width), and 12-17 an optional square capping the end point */
+      const vec4 corners[ 18 ] = vec4[ 18 ](
+        vec4( 0, 0, -1, -1 ), vec4( 0, 0, -1, 1 ), vec4( 1, 0, -1, 1 ),
+        vec4( 0, 0, -1, -1 ), vec4( 1, 0, -1, -1 ), vec4( 1, 0, -1, 1 ),
+        vec4( 1, 0, -1, -1 ), vec4( 1, 1, -1, -1 ), vec4( 1, 1, 1, -1 ),
+        vec4( 1, 0, -1, -1 ), vec4( 1, 0, 1, -1 ), vec4( 1, 1, 1, -1 ),
+        vec4( 1, 1, -1, -1 ), vec4( 1, 1, -1, 1 ), vec4( 1, 1, 1, 1 ),
+        vec4( 1, 1, -1, -1 ), vec4( 1, 1, 1, -1 ), vec4( 1, 1, 1, 1 ) );
+
+      void main()
+      {
+        vec2 start = vec2( start_t, start_y ) * scale + offset;
+        vec2 end = vec2( end_t, end_y ) * scale + offset;
+
+        vec4 corner = corners[ gl_VertexID ];
+
+        float width = halfwidth;
+        if ( gl_VertexID >= 6 && gl_VertexID < 12 && !(end.y > start.y) ) {
+          width = -halfwidth;
+        }
+
+        /* when feathering, widen each quad by half the feather across the line
+           (the horizontal quad in y, the vertical one in x, the square both ways) */
+        vec2 across = gl_VertexID < 6 ? vec2( 0, 1 ) : gl_VertexID < 12 ? vec2( 1, 0 ) : vec2( 1, 1 );
+        vec2 reach = corner.zw * (width + sign( width ) * feather / 2 * across);
+
+        vec2 pixel = vec2( mix( start.x, end.x, corner.x ), mix( start.y, end.y, corner.y ) ) + reach;
+
+	gl_Position = vec4( 2 * pixel.x / window_size.x - 1.0,
+                            1.0 - 2 * pixel.y / window_size.y, 0.0, 1.0 );
+        raw_position = pixel;
+        edge_offset = reach * across;
+        edge_halfwidth = halfwidth;
+      }
+    )";
+
+const std::string Display::shader_source_step_segment_batch
+= R"( #version 140
+
+      uniform uvec2 window_size;
+      uniform vec2 scale;
+      uniform vec2 offset;
+      uniform float feather;
+
+      layout(std140) uniform SeriesStyles
+      {
+        vec4 colors[ 64 ];
+        vec4 halfwidths[ 64 ]; /* in x */
+      };
+
+      /* (time, value) and (series, cap the end with a square?) */
+      in float start_t;
+      in float start_y;
+      in vec2 start_style;
+      in float end_t;
+      in float end_y;
+      in vec2 end_style;
+
+      out vec2 raw_position;
+      out vec2 edge_offset;
+      flat out float edge_halfwidth;
+      flat out vec4 series_color;
+
+      /* as in the single-series instanced shader */
+      const vec4 corners[ 18 ] = vec4[ 18 ](
+        vec4( 0, 0, -1, -1 ), vec4( 0, 0, -1, 1 ), vec4( 1, 0, -1, 1 ),
+        vec4( 0, 0, -1, -1 ), vec4( 1, 0, -1, -1 ), vec4( 1, 0, -1, 1 ),
+        vec4( 1, 0, -1, -1 ), vec4( 1, 1, -1, -1 ), vec4( 1, 1, 1, -1 ),
+        vec4( 1, 0, -1, -1 ), vec4( 1, 0, 1, -1 ), vec4( 1, 1, 1, -1 ),
+        vec4( 1, 1, -1, -1 ), vec4( 1, 1, -1, 1 ), vec4( 1, 1, 1, 1 ),
+        vec4( 1, 1, -1, -1 ), vec4( 1, 1, 1, -1 ), vec4( 1, 1, 1, 1 ) );
+
+      void main()
+      {
+        vec4 start = vec4( start_t, start_y, start_style );
+        vec4 end = vec4( end_t, end_y, end_style );
+
+        /* collapse segments that join two series, and squares that aren't wanted */
+        if ( start.z != end.z || (gl_VertexID >= 12 && end.w == 0) ) {
+          gl_Position = vec4( 0, 0, 0, 1 );
+          raw_position = vec2( 0, 0 );
+          edge_offset = vec2( 0, 0 );
+          edge_halfwidth = 0;
+          series_color = vec4( 0, 0, 0, 0 );
+          return;
+        }
+
+        int series = int( start.z );
+        float halfwidth = halfwidths[ series ].x;
+
+        vec2 start_pixel = start.xy * scale + offset;
+        vec2 end_pixel = end.xy * scale + offset;
+
+        vec4 corner = corners[ gl_VertexID ];
+
+        float width = halfwidth;
+        if ( gl_VertexID >= 6 && gl_VertexID < 12 && !(end_pixel.y > start_pixel.y) ) {
+          width = -halfwidth;
+        }
+
+        vec2 across = gl_VertexID < 6 ? vec2( 0, 1 ) : gl_VertexID < 12 ? vec2( 1, 0 ) : vec2( 1, 1 );
+        vec2 reach = corner.zw * (width + sign( width ) * feather / 2 * across);
+
+        vec2 pixel = vec2( mix( start_pixel.x, end_pixel.x, corner.x ), mix( start_pixel.y, end_pixel.y, corner.y ) )
+                     + reach;
+
+	gl_Position = vec4( 2 * pixel.x / window_size.x - 1.0,
+                            1.0 - 2 * pixel.y / window_size.y, 0.0, 1.0 );
+        raw_position = pixel;
+        edge_offset = reach * across;
+        edge_halfwidth = halfwidth;
+        series_color = colors[ series ];
+      }
+    )";
+
 const std::string Display::shader_source_passthrough_texture
 = R"( #version 140
 
       uniform sampler2DRect tex;
+      uniform float scroll;
+      uniform float wrap_width;
 
       in vec2 raw_position;
       out vec4 outColor;
 
       void main()
       {
-        outColor = texture( tex, raw_position );
+        outColor = texture( tex, vec2( mod( raw_position.x + scroll, wrap_width ), raw_position.y ) );
       }
     )";
 
@@ -55,84 +221,329 @@ const std::string Display::shader_source_solid_color
       }
     )";
 
+const std::string Display::shader_source_series_color
+= R"( #version 140
+
+      uniform float cutoff;
+      uniform float feather;
+
+      in vec2 raw_position;
+      in vec2 edge_offset;
+      flat in float edge_halfwidth;
+      flat in vec4 series_color;
+      out vec4 outColor;
+
+      void main()
+      {
+        if ( raw_position.x < cutoff ) {
+          outColor = mix( series_color, vec4( series_color.xyz, 0 ), (cutoff - raw_position.x) / (cutoff / 3.0) );
+        } else {
+          outColor = series_color;
+        }
+
+        /* as in the solid-color coverage shader */
+        if ( feather > 0 ) {
+          float distance = max( abs( edge_offset.x ), abs( edge_offset.y ) );
+          outColor.a *= clamp( (edge_halfwidth - distance) / feather + 0.5, 0.0, 1.0 );
+        }
+      }
+    )";
+
+const std::string Display::shader_source_solid_color_coverage
+= R"( #version 140
+
+      uniform vec4 color;
+      uniform float cutoff;
+      uniform float feather;
+
+      in vec2 raw_position;
+      in vec2 edge_offset;         /* pixels from the line's center, across it */
+      flat in float edge_halfwidth;
+      out vec4 outColor;
+
+      void main()
+      {
+        if ( raw_position.x < cutoff ) {
+          outColor = mix( color, vec4( color.x, color.y, color.z, 0 ), (cutoff - raw_position.x) / (cutoff / 3.0) );
+        } else {
+          outColor = color;
+        }
+
+        /* the share of this pixel the line covers, taking the pixel as
+           a box a pixel (the feather) wide: half at the line's true edge */
+        if ( feather > 0 ) {
+          float distance = max( abs( edge_offset.x ), abs( edge_offset.y ) );
+          outColor.a *= clamp( (edge_halfwidth - distance) / feather + 0.5, 0.0, 1.0 );
+        }
+      }
+    )";
+
+const std::string Display::shader_source_text_glyph
+= R"( #version 140
+
+      uniform uvec2 window_size;
+
+      in vec4 quad;      /* offset from the label's center, and size */
+      in vec4 atlas;     /* the glyph's rectangle in the atlas */
+      in vec4 placement; /* label center, angle, alpha */
+
+      out vec2 atlas_position;
+      flat out float alpha;
+
+      const vec2 corners[ 4 ] = vec2[ 4 ]( vec2( 0, 0 ), vec2( 0, 1 ), vec2( 1, 1 ), vec2( 1, 0 ) );
+
+      void main()
+      {
+        vec2 corner = corners[ gl_VertexID ];
+        vec2 offset = quad.xy + corner * quad.zw;
+
+        float c = cos( placement.z );
+        float s = sin( placement.z );
+        vec2 pixel = placement.xy + vec2( offset.x * c - offset.y * s, offset.x * s + offset.y * c );
+
+	gl_Position = vec4( 2 * pixel.x / window_size.x - 1.0,
+                            1.0 - 2 * pixel.y / window_size.y, 0.0, 1.0 );
+        atlas_position = atlas.xy + corner * atlas.zw;
+        alpha = placement.w;
+      }
+    )";
+
+const std::string Display::shader_source_sdf_text
+= R"( #version 140
+
+      uniform sampler2DRect tex;
+      uniform vec3 color;
+
+      in vec2 atlas_position;
+      flat in float alpha;
+      out vec4 outColor;
+
+      void main()
+      {
+        /* the outline is at 0.5; smooth over about a pixel, whatever the scale */
+        float distance = texture( tex, atlas_position ).r;
+        float edge = 0.7 * fwidth( distance );
+        outColor = vec4( color, alpha * smoothstep( 0.5 - edge, 0.5 + edge, distance ) );
+      }
+    )";
+
 Display::CurrentContextWindow::CurrentContextWindow( const unsigned int width, const unsigned int height,
-						     const string & title )
-  : window_( width, height, title )
+						     const string & title, const bool visible,
+						     const Window * const share, const unsigned int samples )
+  : window_( width, height, title, visible, share, samples )
 {
   window_.make_context_current( true );
 }
 
-Display::Display( const unsigned int width, const unsigned int height,
-		  const string & title )
-  : current_context_window_( width, height, title ),
-    texture_( width, height )
+Display::Offscreen::Offscreen( const unsigned int width, const unsigned int height, const unsigned int samples )
+  : size( width, height )
 {
-  glCheck( "starting Display constructor" );
+  /* match the multisampling that the window asks for */
+  multisample_color.storage( GL_RGBA8, width, height, samples );
+  multisample.attach_color( multisample_color );
 
-  /* set up shader programs. both use the same vertex shader */
+  resolved_color.storage( GL_RGBA8, width, height );
+  resolved.attach_color( resolved_color );
+
+  multisample.bind();
+}
+
+Display::Programs::Programs()
+{
+  glCheck( "before linking shader programs" );
 
   /* the texture shader program blits a texture to the screen */
-  texture_shader_program_.attach( scale_from_pixel_coordinates_ );
-  texture_shader_program_.attach( passthrough_texture_ );
-  texture_shader_program_.link();
+  texture.attach( scale_from_pixel_coordinates );
+  texture.attach( passthrough_texture );
+  texture.link();
   glCheck( "after linking texture shader program" );
 
   /* the solid-color shader program just paints triangles of a given color */
-  solid_color_shader_program_.attach( scale_from_pixel_coordinates_ );
-  solid_color_shader_program_.attach( solid_color_ );
-  solid_color_shader_program_.link();
+  solid_color.attach( scale_from_pixel_coordinates );
+  solid_color.attach( solid_color_fragment );
+  solid_color.link();
   glCheck( "after linking solid-color shader program" );
 
+  /* the streaming program paints the same way, but positions come in data coordinates */
+  streaming.attach( scale_from_data_coordinates );
+  streaming.attach( solid_color_fragment );
+  streaming.link();
+  glCheck( "after linking streaming shader program" );
+
+  /* the instanced program expands raw samples into step segments on the GPU */
+  instanced.attach( step_segment_instance );
+  instanced.attach( solid_color_coverage );
+  instanced.link();
+  glCheck( "after linking instanced shader program" );
+
+  /* the batch program does the same for many series at once, colored per series */
+  batch.attach( step_segment_batch );
+  batch.attach( series_color );
+  batch.link();
+  batch.uniform_block_binding( "SeriesStyles", 0 );
+  glCheck( "after linking batch shader program" );
+
+  /* the text program draws glyph quads out of a distance-field atlas */
+  text.attach( text_glyph );
+  text.attach( sdf_text );
+  text.link();
+  glCheck( "after linking text shader program" );
+}
+
+SharedContext::Root::Root()
+  : window( 1, 1, "glfun", false )
+{
+  window.make_context_current( true );
+}
+
+SharedContext::SharedContext()
+  : root_(),
+    programs_( make_shared<Display::Programs>() )
+{}
+
+SharedContext::~SharedContext()
+{
+  /* the programs are deleted from here */
+  root_.window.make_context_current();
+}
+
+Display::Display( const unsigned int width, const unsigned int height,
+		  const string & title, const bool offscreen, const Antialiasing antialiasing )
+  : Display( nullptr, width, height, title, offscreen, antialiasing )
+{}
+
+/* samples per pixel when multisampling */
+static const unsigned int multisamples = 4;
+
+Display::Display( SharedContext * const shared, const unsigned int width, const unsigned int height,
+		  const string & title, const bool offscreen, const Antialiasing antialiasing )
+  : current_context_window_( width, height, title, not offscreen, shared ? &shared->root_.window : nullptr,
+			     antialiasing == Antialiasing::Multisample ? multisamples : 0 ),
+    offscreen_( offscreen ? new Offscreen( width, height,
+					   antialiasing == Antialiasing::Multisample ? multisamples : 0 ) : nullptr ),
+    programs_( shared ? shared->programs_ : make_shared<Programs>() ),
+    texture_( width, height ),
+    antialiasing_( antialiasing )
+{
+  glCheck( "starting Display constructor" );
+
   /* set up vertex array for corners of display */
   texture_shader_array_object_.bind();
   ArrayBuffer::bind( screen_corners_ );
-  glVertexAttribPointer( texture_shader_program_.attribute_location( "position" ),
+  glVertexAttribPointer( programs_->texture.attribute_location( "position" ),
 			 2, GL_FLOAT, GL_FALSE, 0, 0 );
-  glEnableVertexAttribArray( texture_shader_program_.attribute_location( "position" ) );
+  glEnableVertexAttribArray( programs_->texture.attribute_location( "position" ) );
 
   solid_color_array_object_.bind();
   ArrayBuffer::bind( other_vertices_ );
-  glVertexAttribPointer( solid_color_shader_program_.attribute_location( "position" ),
+  glVertexAttribPointer( programs_->solid_color.attribute_location( "position" ),
 			 2, GL_FLOAT, GL_FALSE, 0, 0 );
-  glEnableVertexAttribArray( solid_color_shader_program_.attribute_location( "position" ) );
-  glCheck( "after setting up vertex attribute arrays" );
+  glEnableVertexAttribArray( programs_->solid_color.attribute_location( "position" ) );
+
+  stream_.array_object.bind();
+  ArrayBuffer::bind( stream_.vertices );
+  glVertexAttribPointer( programs_->streaming.attribute_location( "t" ),
+			 1, GL_FLOAT, GL_FALSE, sizeof( StreamVertex ),
+			 reinterpret_cast<const GLvoid *>( offsetof( StreamVertex, t ) ) );
+  glEnableVertexAttribArray( programs_->streaming.attribute_location( "t" ) );
+  glVertexAttribPointer( programs_->streaming.attribute_location( "y" ),
+			 1, GL_UNSIGNED_SHORT, GL_TRUE, sizeof( StreamVertex ),
+			 reinterpret_cast<const GLvoid *>( offsetof( StreamVertex, y ) ) );
+  glEnableVertexAttribArray( programs_->streaming.attribute_location( "y" ) );
+  glVertexAttribPointer( programs_->streaming.attribute_location( "pixel_offset" ),
+			 2, GL_BYTE, GL_FALSE, sizeof( StreamVertex ),
+			 reinterpret_cast<const GLvoid *>( offsetof( StreamVertex, dx ) ) );
+  glEnableVertexAttribArray( programs_->streaming.attribute_location( "pixel_offset" ) );
+
+  instanced_.array_object.bind();
+  for ( const auto & name : { "start_t", "start_y", "end_t", "end_y" } ) {
+    glEnableVertexAttribArray( programs_->instanced.attribute_location( name ) );
+    glVertexAttribDivisor( programs_->instanced.attribute_location( name ), 1 );
+  }
+
+  /* each batch instance reads one sample as its start, and the next as its end */
+  batch_.array_object.bind();
+  ArrayBuffer::bind( batch_.samples );
+  for ( const auto & role : { make_pair( "start", size_t( 0 ) ), make_pair( "end", sizeof( BatchSample ) ) } ) {
+    glVertexAttribPointer( programs_->batch.attribute_location( role.first + string( "_t" ) ),
+			   1, GL_FLOAT, GL_FALSE, sizeof( BatchSample ),
+			   reinterpret_cast<const GLvoid *>( role.second + offsetof( BatchSample, t ) ) );
+    glVertexAttribPointer( programs_->batch.attribute_location( role.first + string( "_y" ) ),
+			   1, GL_UNSIGNED_SHORT, GL_TRUE, sizeof( BatchSample ),
+			   reinterpret_cast<const GLvoid *>( role.second + offsetof( BatchSample, y ) ) );
+    glVertexAttribPointer( programs_->batch.attribute_location( role.first + string( "_style" ) ),
+			   2, GL_UNSIGNED_BYTE, GL_FALSE, sizeof( BatchSample ),
+			   reinterpret_cast<const GLvoid *>( role.second + offsetof( BatchSample, series ) ) );
+  }
 
-  /* set sync-to-vblank */
-  glfwSwapInterval( 1 );
+  for ( const auto & name : { "start_t", "start_y", "start_style", "end_t", "end_y", "end_style" } ) {
+    glEnableVertexAttribArray( programs_->batch.attribute_location( name ) );
+    glVertexAttribDivisor( programs_->batch.attribute_location( name ), 1 );
+  }
+
+  /* each text instance is one glyph quad */
+  text_.array_object.bind();
+  ArrayBuffer::bind( text_.quads );
+  glVertexAttribPointer( programs_->text.attribute_location( "quad" ), 4, GL_FLOAT, GL_FALSE,
+			 sizeof( TextQuad ), reinterpret_cast<const GLvoid *>( offsetof( TextQuad, x ) ) );
+  glVertexAttribPointer( programs_->text.attribute_location( "atlas" ), 4, GL_FLOAT, GL_FALSE,
+			 sizeof( TextQuad ), reinterpret_cast<const GLvoid *>( offsetof( TextQuad, u ) ) );
+  glVertexAttribPointer( programs_->text.attribute_location( "placement" ), 4, GL_FLOAT, GL_FALSE,
+			 sizeof( TextQuad ), reinterpret_cast<const GLvoid *>( offsetof( TextQuad, center_x ) ) );
+  for ( const auto & name : { "quad", "atlas", "placement" } ) {
+    glEnableVertexAttribArray( programs_->text.attribute_location( name ) );
+    glVertexAttribDivisor( programs_->text.attribute_location( name ), 1 );
+  }
 
-  /* set up texture */
-  texture_.bind();
-  glTexParameteri( GL_TEXTURE_RECTANGLE, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
-  glTexParameteri( GL_TEXTURE_RECTANGLE, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
-  glTexParameteri( GL_TEXTURE_RECTANGLE, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
-  glTexParameteri( GL_TEXTURE_RECTANGLE, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+  UniformBuffer::bind( batch_.styles );
+  UniformBuffer::allocate( 2 * max_batch_series * 4 * sizeof( float ), GL_DYNAMIC_DRAW );
+  glCheck( "after setting up vertex attribute arrays" );
+
+  /* set sync-to-vblank (nothing to sync to when offscreen) */
+  swap_interval_ = offscreen_ ? 0 : 1;
+  Window::set_swap_interval( swap_interval_ );
+  set_swap_interval_ = swap_interval_;
 
   /* set size of viewport and tell shader program */
-  const pair<unsigned int, unsigned int> window_size = window().size();
-  resize( window_size );
+  resize( size() );
 
   /* set up alpha-blending */
   glEnable( GL_BLEND );
   glBlendFunc( GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA );
 
   /* hide cursor */
-  current_context_window_.window_.hide_cursor( true );
+  if ( not offscreen_ ) {
+    current_context_window_.window_.hide_cursor( true );
+  }
 
   glCheck( "at end of Display constructor" );
 }
 
+Display::~Display()
+{
+  /* vertex arrays, framebuffers and queries belong to this context alone */
+  current_context_window_.window_.make_context_current();
+
+  if ( programs_->window_size_owner == this ) {
+    programs_->window_size_owner = nullptr;
+  }
+}
+
+void Display::make_current( void )
+{
+  current_context_window_.window_.make_context_current();
+
+  if ( programs_->window_size_owner != this ) {
+    set_window_size_uniforms();
+  }
+}
+
 void Display::resize( const pair<unsigned int, unsigned int> & target_size )
 {
   /* set size of viewport and tell shader program */
   glViewport( 0, 0, target_size.first, target_size.second );
-
-  texture_shader_program_.use();
-  glUniform2ui( texture_shader_program_.uniform_location( "window_size" ),
-		target_size.first, target_size.second );
-
-  solid_color_shader_program_.use();
-  glUniform2ui( solid_color_shader_program_.uniform_location( "window_size" ),
-		target_size.first, target_size.second );
+  viewport_size_ = target_size;
+  set_window_size_uniforms();
 
   /* load new coordinates of corners of image rectangle */
   const vector<pair<float, float>> corners = { { 0, 0 },
@@ -149,6 +560,17 @@ void Display::resize( const pair<unsigned int, unsigned int> & target_size )
   glCheck( "after resizing" );
 }
 
+void Display::set_window_size_uniforms( void )
+{
+  for ( Program * program : { &programs_->texture, &programs_->solid_color, &programs_->streaming,
+			      &programs_->instanced, &programs_->batch, &programs_->text } ) {
+    program->use();
+    glUniform2ui( program->uniform_location( "window_size" ), viewport_size_.first, viewport_size_.second );
+  }
+
+  programs_->window_size_owner = this;
+}
+
 void Display::draw( const Image & image )
 {
   texture_.load( image );
@@ -157,35 +579,334 @@ void Display::draw( const Image & image )
 
 void Display::repaint( void )
 {
-  ArrayBuffer::bind( screen_corners_ );
+  composite( texture_, false );
+}
+
+void Display::composite( Texture & layer, const bool premultiplied, const float scroll_x )
+{
+  ScopedTimer timer( profiler_, Profiler::Submit );
+  GpuTimer::Scope gpu_timer( gpu_timer_.get(), Profiler::Layers );
+
+  /* the vertex array already points at screen_corners_ */
   texture_shader_array_object_.bind();
-  texture_shader_program_.use();
+  programs_->texture.use();
+  layer.bind();
+
+  glUniform1f( programs_->texture.uniform_location( "scroll" ), scroll_x );
+  glUniform1f( programs_->texture.uniform_location( "wrap_width" ), layer.size().first );
+
+  if ( premultiplied ) {
+    glBlendFunc( GL_ONE, GL_ONE_MINUS_SRC_ALPHA );
+  }
+
   glDrawArrays( GL_TRIANGLE_FAN, 0, 4 );
+  GLState::submitted( 4 );
+
+  if ( premultiplied ) {
+    glBlendFunc( GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA );
+  }
+}
+
+pair<unsigned int, unsigned int> Display::size( void ) const
+{
+  return offscreen_ ? offscreen_->size : window().size();
+}
+
+double Display::refresh_interval( void ) const
+{
+  if ( offscreen_ ) {
+    return 0;
+  }
+
+  const double rate = window().refresh_rate();
+  return rate > 0 ? 1.0 / rate : 0;
+}
+
+void Display::set_profiler( Profiler * const profiler )
+{
+  profiler_ = profiler;
+
+  if ( profiler_ and not gpu_timer_ ) {
+    gpu_timer_.reset( new GpuTimer() );
+  } else if ( not profiler_ ) {
+    gpu_timer_.reset();
+  }
 }
 
 void Display::swap( void )
 {
-  current_context_window_.window_.swap_buffers();
+  ScopedTimer timer( profiler_, Profiler::Swap );
+
+  /* offscreen, resolve the multisampled frame, then go back to drawing into it */
+  if ( offscreen_ ) {
+    GpuTimer::Scope gpu_timer( gpu_timer_.get(), Profiler::Resolve );
+
+    const auto & size = offscreen_->size;
+    offscreen_->multisample.bind( GL_READ_FRAMEBUFFER );
+    offscreen_->resolved.bind( GL_DRAW_FRAMEBUFFER );
+    glBlitFramebuffer( 0, 0, size.first, size.second, 0, 0, size.first, size.second,
+		       GL_COLOR_BUFFER_BIT, GL_NEAREST );
+
+    /* start reading it back, waiting only if every buffer is still in flight */
+    if ( video_writer_ ) {
+      if ( pixel_pack_ring_->full() ) {
+	collect_frame( true );
+      }
+
+      offscreen_->resolved.bind( GL_READ_FRAMEBUFFER );
+      pixel_pack_ring_->read( size.first, size.second );
+    }
+
+    offscreen_->multisample.bind();
+  }
+
+  /* the frame being finished is the next one the profiler will record */
+  if ( profiler_ ) {
+    profiler_->count( GLState::frame().vertices, GLState::frame().uploaded );
+
+    gpu_timer_->end_frame( profiler_->frame_count(), gpu_results_ );
+    for ( const auto & result : gpu_results_ ) {
+      profiler_->add_gpu( result.frame, static_cast<Profiler::GpuPass>( result.pass ), result.seconds );
+    }
+    gpu_results_.clear();
+  }
+
+  GLState::end_frame();
+
+  if ( not offscreen_ ) {
+    if ( swap_interval_ != set_swap_interval_ ) {
+      Window::set_swap_interval( swap_interval_ );
+      set_swap_interval_ = swap_interval_;
+    }
+
+    current_context_window_.window_.swap_buffers();
+  }
+
+  if ( synchronous_swap_ ) {
+    glFinish();
+  } else if ( offscreen_ ) {
+    glFlush();
+  }
+
+  /* hand on whatever earlier frames have arrived */
+  while ( video_writer_ and collect_frame( false ) ) {}
+}
+
+void Display::set_video_writer( VideoWriter * const writer )
+{
+  if ( writer and not offscreen_ ) {
+    throw runtime_error( "recording is only available offscreen" );
+  }
+
+  make_current();
+
+  if ( pixel_pack_ring_ ) {
+    while ( collect_frame( true ) ) {}
+  }
+
+  video_writer_ = writer;
+
+  if ( video_writer_ and not pixel_pack_ring_ ) {
+    pixel_pack_ring_.reset( new PixelPackRing() );
+  } else if ( not video_writer_ ) {
+    pixel_pack_ring_.reset();
+  }
+}
+
+bool Display::collect_frame( const bool wait )
+{
+  return pixel_pack_ring_->collect( wait,
+				    [&] ( const uint8_t * pixels, const pair<unsigned int, unsigned int> & size ) {
+				      video_writer_->add_frame( pixels, size.first, size.second,
+								size_t( size.first ) * sizeof( uint32_t ) );
+				    } );
+}
+
+void Display::read_frame( Image & image )
+{
+  if ( not offscreen_ ) {
+    throw runtime_error( "read_frame is only available offscreen" );
+  }
+
+  make_current();
+
+  if ( image.size() != offscreen_->size ) {
+    throw runtime_error( "image size does not match offscreen framebuffer" );
+  }
+
+  offscreen_->resolved.bind( GL_READ_FRAMEBUFFER );
+  glPixelStorei( GL_PACK_ROW_LENGTH, image.stride_pixels() );
+  glReadPixels( 0, 0, image.size().first, image.size().second, GL_BGRA, GL_UNSIGNED_BYTE, image.raw_pixels() );
+  offscreen_->multisample.bind();
+
+  /* OpenGL's first row is the bottom one */
+  for ( unsigned int y = 0; y < image.size().second / 2; y++ ) {
+    unsigned char * top = image.raw_pixels() + y * image.stride_bytes();
+    unsigned char * bottom = image.raw_pixels() + (image.size().second - 1 - y) * image.stride_bytes();
+    swap_ranges( top, top + image.size().first * sizeof( Pixel ), bottom );
+  }
 }
 
 void Display::draw( const float red, const float green, const float blue, const float alpha,
 		    const float width,
 		    const float cutoff,
-		    const deque<pair<float, float>> & vertices,
-		    const std::function<std::pair<float, float>(const std::pair<float, float> &)> & transform )
+		    const SampleRing & samples,
+		    const float extension_time,
+		    const AffineTransform & transform )
+{
+  if ( samples.empty() ) {
+    return;
+  }
+
+  GpuTimer::Scope gpu_timer( gpu_timer_.get(), Profiler::Lines );
+
+  /* analytic antialiasing needs the shader to know the segments */
+  const LineMode mode = antialiasing_ == Antialiasing::Analytic ? LineMode::Instanced : line_mode_;
+
+  Program & program = mode == LineMode::Streaming ? programs_->streaming
+    : mode == LineMode::Instanced ? programs_->instanced
+    : programs_->solid_color;
+
+  program.use();
+  glUniform4f( program.uniform_location( "color" ), red, green, blue, alpha );
+  glUniform1f( program.uniform_location( "cutoff" ), cutoff );
+
+  const SampleRing & drawn = decimate( samples, transform );
+
+  switch ( mode ) {
+  case LineMode::Immediate:
+    draw_immediate( width, drawn, extension_time, transform );
+    break;
+  case LineMode::Streaming:
+    draw_streaming( width, drawn, extension_time, transform );
+    break;
+  case LineMode::Instanced:
+    draw_instanced( width, drawn, extension_time, transform );
+    break;
+  }
+}
+
+/* decimate only once there are this many samples per pixel column */
+static const double decimation_threshold = 8;
+
+/* are the samples' times in order? (a lagging producer can append
+   samples older than the ones before them) */
+static bool times_in_order( const SampleRing & samples )
+{
+  const auto spans = samples.spans();
+  float previous = -numeric_limits<float>::infinity();
+  for ( const SampleRing::Span & span : { spans.first, spans.second } ) {
+    for ( size_t i = 0; i < span.length; i++ ) {
+      if ( span.times[ i ] < previous ) {
+	return false;
+      }
+      previous = span.times[ i ];
+    }
+  }
+  return true;
+}
+
+/* the room reduce_columns() needs, or 0 if the samples are not dense
+   enough to be worth reducing, or are out of order (and so are drawn
+   as they are, rather than reduced only in part) */
+static size_t reduced_size_bound( const SampleRing & samples, const AffineTransform & transform )
+{
+  const double first_x = samples.front_time() * transform.x_scale + transform.x_offset;
+  const double last_x = samples.back_time() * transform.x_scale + transform.x_offset;
+  const double columns = floor( last_x ) - floor( first_x ) + 1;
+
+  if ( not (columns >= 1) or samples.size() < decimation_threshold * columns
+       or not times_in_order( samples ) ) {
+    return 0;
+  }
+
+  return min( 4 * size_t( columns ), samples.size() );
+}
+
+/* call emit( t, y ) with the first, minimum, maximum and last sample of
+   each pixel column, in time order and without repeats (M4), at most
+   limit times (a guard that samples in time order never reach) */
+template <class Emit>
+static void reduce_columns( const SampleRing & samples, const AffineTransform & transform,
+			    const size_t limit, Emit && emit )
+{
+  const size_t size = samples.size();
+  size_t emitted = 0;
+  size_t i = 0;
+  while ( i < size ) {
+    const double column = floor( samples.time( i ) * transform.x_scale + transform.x_offset );
+
+    size_t lowest = i, highest = i, last = i;
+    for ( size_t j = i + 1;
+	  j < size and floor( samples.time( j ) * transform.x_scale + transform.x_offset ) == column;
+	  j++ ) {
+      if ( samples.value( j ) < samples.value( lowest ) ) {
+	lowest = j;
+      }
+      if ( samples.value( j ) > samples.value( highest ) ) {
+	highest = j;
+      }
+      last = j;
+    }
+
+    const size_t picks[ 4 ] = { i, min( lowest, highest ), max( lowest, highest ), last };
+    for ( unsigned int k = 0; k < 4; k++ ) {
+      if ( k == 0 or picks[ k ] != picks[ k - 1 ] ) {
+	if ( emitted == limit ) {
+	  return;
+	}
+	emit( samples.time( picks[ k ] ), samples.value( picks[ k ] ) );
+	emitted++;
+      }
+    }
+
+    i = last + 1;
+  }
+}
+
+const SampleRing & Display::decimate( const SampleRing & samples, const AffineTransform & transform )
+{
+  const size_t needed = decimation_ ? reduced_size_bound( samples, transform ) : 0;
+
+  if ( not needed ) {
+    return samples;
+  }
+
+  ScopedTimer timer( profiler_, Profiler::Geometry );
+
+  /* only grow, so the GPU copies rarely need reallocating */
+  if ( decimated_.capacity() < needed ) {
+    size_t capacity = decimated_.capacity();
+    while ( capacity < needed ) {
+      capacity *= 2;
+    }
+    decimated_ = SampleRing( capacity );
+  }
+
+  /* clearing keeps the push count going, so the streaming and instanced
+     paths see the whole reduction as new samples and re-upload it */
+  decimated_.clear();
+
+  reduce_columns( samples, transform, needed,
+		  [&] ( const float t, const float y ) { decimated_.push_back( t, y ); } );
+
+  return decimated_;
+}
+
+void Display::draw_immediate( const float width, const SampleRing & samples,
+			      const float extension_time, const AffineTransform & transform )
 {
+  ScopedTimer timer( profiler_, Profiler::Geometry );
+
   ArrayBuffer::bind( other_vertices_ );
   solid_color_array_object_.bind();
-  solid_color_shader_program_.use();
 
   const float halfwidth = width / 2;
 
   vector<pair<float, float>> triangles;
+  triangles.reserve( 12 * samples.size() + 6 );
 
-  for ( auto it = vertices.begin(); it < vertices.end() - 1; it++ ) {
-    auto start = transform( *it );
-    const auto end = transform( *(it + 1) );
-
+  auto add_segment = [&] ( const pair<float, float> & start, const pair<float, float> & end ) {
     /* horizontal portion */
     triangles.emplace_back( start.first - halfwidth, start.second - halfwidth );
     triangles.emplace_back( start.first - halfwidth, start.second + halfwidth );
@@ -205,34 +926,497 @@ void Display::draw( const float red, const float green, const float blue, const
     triangles.emplace_back( end.first - adjwidth, start.second - adjwidth );
     triangles.emplace_back( end.first + adjwidth, start.second - adjwidth );
     triangles.emplace_back( end.first + adjwidth, end.second - adjwidth );
-  }
+  };
 
-  if ( not vertices.empty() ) {
-    const auto last = transform( vertices.back() );
+  /* walk both contiguous spans of the ring */
+  const auto spans = samples.spans();
+  pair<float, float> last = transform( make_pair( samples.time( 0 ), samples.value( 0 ) ) );
 
-    /* fill in last square */
-    triangles.emplace_back( last.first - halfwidth, last.second - halfwidth );
-    triangles.emplace_back( last.first - halfwidth, last.second + halfwidth );
-    triangles.emplace_back( last.first + halfwidth, last.second + halfwidth );
+  for ( size_t i = 1; i < spans.first.length; i++ ) {
+    const auto next = transform( make_pair( spans.first.times[ i ], spans.first.values[ i ] ) );
+    add_segment( last, next );
+    last = next;
+  }
 
-    triangles.emplace_back( last.first - halfwidth, last.second - halfwidth );
-    triangles.emplace_back( last.first + halfwidth, last.second - halfwidth );   
-    triangles.emplace_back( last.first + halfwidth, last.second + halfwidth );
+  for ( size_t i = 0; i < spans.second.length; i++ ) {
+    const auto next = transform( make_pair( spans.second.times[ i ], spans.second.values[ i ] ) );
+    add_segment( last, next );
+    last = next;
   }
 
-  ArrayBuffer::load( triangles, GL_STREAM_DRAW );
+  /* extend the last value to the requested time (e.g. off the right edge) */
+  const auto extension = transform( make_pair( extension_time, samples.back_value() ) );
+  add_segment( last, extension );
+  last = extension;
 
-  solid_color_shader_program_.use();
-  glUniform4f( solid_color_shader_program_.uniform_location( "color" ),
-	       red, green, blue, alpha );
+  /* fill in last square */
+  triangles.emplace_back( last.first - halfwidth, last.second - halfwidth );
+  triangles.emplace_back( last.first - halfwidth, last.second + halfwidth );
+  triangles.emplace_back( last.first + halfwidth, last.second + halfwidth );
 
-  glUniform1f( solid_color_shader_program_.uniform_location( "cutoff" ),
-	       cutoff );
+  triangles.emplace_back( last.first - halfwidth, last.second - halfwidth );
+  triangles.emplace_back( last.first + halfwidth, last.second - halfwidth );
+  triangles.emplace_back( last.first + halfwidth, last.second + halfwidth );
+
+  timer.next( Profiler::Submit );
+
+  ArrayBuffer::load( triangles, GL_STREAM_DRAW );
 
   glDrawArrays( GL_TRIANGLES, 0, triangles.size() );
+  GLState::submitted( triangles.size() );
+}
+
+/* encoded values cover this many times the visible range, centered on it,
+   and are encoded afresh once the view is this much smaller than that */
+static const float encoded_range_factor = 5;
+static const float encoded_range_max_zoom = 4;
+
+uint16_t Display::ValueRange::quantize( const float y ) const
+{
+  const float fraction = (y - bottom) / span;
+  return lrintf( 65535 * min( 1.0f, max( 0.0f, fraction ) ) );
+}
+
+bool Display::ValueRange::suits( const ValueRange & visible ) const
+{
+  return (span > 0) and (visible.bottom >= bottom) and (visible.bottom + visible.span <= bottom + span)
+    and (visible.span * encoded_range_factor * encoded_range_max_zoom >= span);
+}
+
+Display::ValueRange Display::ValueRange::around( const ValueRange & visible )
+{
+  const float span = visible.span * encoded_range_factor;
+  return ValueRange( { visible.bottom + visible.span / 2 - span / 2, span } );
+}
+
+Display::ValueRange Display::visible_values( const AffineTransform & transform, const float margin ) const
+{
+  const float top = -(transform.y_offset + margin) / transform.y_scale;
+  const float bottom = (size().second + margin - transform.y_offset) / transform.y_scale;
+  const float span = fabs( top - bottom );
+
+  return ValueRange( { min( top, bottom ), (span > 0 and isfinite( span )) ? span : 1.0f } );
+}
+
+AffineTransform Display::encoded( const AffineTransform & transform, const ValueRange & range )
+{
+  return AffineTransform( { transform.x_scale, transform.x_offset,
+			    transform.y_scale * range.span, transform.y_offset + transform.y_scale * range.bottom } );
+}
+
+Display::StreamVertex * Display::stream_segment( StreamVertex * out,
+						 const float start_t, const float start_y,
+						 const float end_t, const float end_y,
+						 const ValueRange & range, const bool y_flipped )
+{
+  const uint16_t start_value = range.quantize( start_y ), end_value = range.quantize( end_y );
+
+  /* horizontal portion */
+  *out++ = StreamVertex( { start_t, start_value, -1, -1 } );
+  *out++ = StreamVertex( { start_t, start_value, -1, 1 } );
+  *out++ = StreamVertex( { end_t, start_value, -1, 1 } );
+
+  *out++ = StreamVertex( { start_t, start_value, -1, -1 } );
+  *out++ = StreamVertex( { end_t, start_value, -1, -1 } );
+  *out++ = StreamVertex( { end_t, start_value, -1, 1 } );
+
+  /* vertical portion (same as draw_immediate: which way does the line go on screen?) */
+  const bool downward = y_flipped ? (end_y < start_y) : (end_y > start_y);
+  const int8_t direction = downward ? 1 : -1;
+
+  *out++ = StreamVertex( { end_t, start_value, int8_t( -direction ), int8_t( -direction ) } );
+  *out++ = StreamVertex( { end_t, end_value, int8_t( -direction ), int8_t( -direction ) } );
+  *out++ = StreamVertex( { end_t, end_value, direction, int8_t( -direction ) } );
+
+  *out++ = StreamVertex( { end_t, start_value, int8_t( -direction ), int8_t( -direction ) } );
+  *out++ = StreamVertex( { end_t, start_value, direction, int8_t( -direction ) } );
+  *out++ = StreamVertex( { end_t, end_value, direction, int8_t( -direction ) } );
+
+  return out;
+}
+
+/* re-base uploaded times (streamed or instanced) before float precision suffers */
+static const float epoch_lifetime = 1024;
+
+void Display::draw_streaming( const float width, const SampleRing & samples,
+			      const float extension_time, const AffineTransform & transform )
+{
+  ScopedTimer timer( profiler_, Profiler::Geometry );
+
+  const bool y_flipped = transform.y_scale < 0;
+  const uint64_t first_live = samples.pushed() - samples.size();
+  const ValueRange visible = visible_values( transform, width / 2 + feather() );
+
+  stream_.array_object.bind();
+  ArrayBuffer::bind( stream_.vertices );
+
+  /* start over if the ring changed, or the view left the range values are encoded against */
+  if ( (not stream_.valid)
+       or (stream_.capacity != samples.capacity())
+       or (not stream_.range.suits( visible ))
+       or (stream_.y_flipped != y_flipped)
+       or (stream_.source != &samples)
+       or (samples.pushed() < stream_.uploaded)
+       or (samples.front_time() - stream_.epoch > epoch_lifetime) ) {
+    if ( stream_.capacity != samples.capacity() ) {
+      stream_.capacity = samples.capacity();
+      ArrayBuffer::allocate( (stream_.capacity * stream_vertices_per_segment + stream_tail_vertices)
+			     * sizeof( StreamVertex ), GL_DYNAMIC_DRAW );
+    }
+
+    stream_.epoch = samples.front_time();
+    stream_.range = ValueRange::around( visible );
+    stream_.y_flipped = y_flipped;
+    stream_.source = &samples;
+    stream_.uploaded = first_live;
+    stream_.valid = true;
+  }
+
+  /* upload the segment leading up to each sample that arrived since the last frame */
+  uint64_t next = max( stream_.uploaded, first_live + 1 );
+  while ( next < samples.pushed() ) {
+    const size_t start_index = next - 1 - first_live;
+    const size_t start_slot = samples.physical_index( start_index );
+
+    /* slots are contiguous until the ring wraps */
+    const size_t count = min<uint64_t>( samples.pushed() - next, stream_.capacity - start_slot );
+
+    StreamVertex * out = static_cast<StreamVertex *>(
+      ArrayBuffer::map_range( start_slot * stream_vertices_per_segment * sizeof( StreamVertex ),
+			      count * stream_vertices_per_segment * sizeof( StreamVertex ),
+			      GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT ) );
+
+    for ( size_t i = start_index; i < start_index + count; i++ ) {
+      out = stream_segment( out,
+			    samples.time( i ) - stream_.epoch, samples.value( i ),
+			    samples.time( i + 1 ) - stream_.epoch, samples.value( i + 1 ),
+			    stream_.range, y_flipped );
+    }
+
+    ArrayBuffer::unmap();
+    next += count;
+  }
+  stream_.uploaded = samples.pushed();
+
+  /* the extension and last square change every frame, so they live in a small tail region */
+  StreamVertex tail[ stream_tail_vertices ];
+  const float last_t = samples.back_time() - stream_.epoch;
+  const float extension_t = extension_time - stream_.epoch;
+  const float last_y = samples.back_value();
+
+  const uint16_t last_value = stream_.range.quantize( last_y );
+
+  StreamVertex * out = stream_segment( tail, last_t, last_y, extension_t, last_y, stream_.range, y_flipped );
+
+  *out++ = StreamVertex( { extension_t, last_value, -1, -1 } );
+  *out++ = StreamVertex( { extension_t, last_value, -1, 1 } );
+  *out++ = StreamVertex( { extension_t, last_value, 1, 1 } );
+
+  *out++ = StreamVertex( { extension_t, last_value, -1, -1 } );
+  *out++ = StreamVertex( { extension_t, last_value, 1, -1 } );
+  *out++ = StreamVertex( { extension_t, last_value, 1, 1 } );
+
+  timer.next( Profiler::Submit );
+
+  const size_t tail_first = stream_.capacity * stream_vertices_per_segment;
+  ArrayBuffer::load_range( tail_first * sizeof( StreamVertex ), sizeof( tail ), tail );
+
+  /* scrolling, autoscaling and the line width are just a change of uniforms */
+  const AffineTransform stream_transform = encoded( transform, stream_.range );
+  glUniform2f( programs_->streaming.uniform_location( "scale" ),
+	       stream_transform.x_scale, stream_transform.y_scale );
+  glUniform2f( programs_->streaming.uniform_location( "offset" ),
+	       stream_transform.x_offset + stream_.epoch * stream_transform.x_scale, stream_transform.y_offset );
+  glUniform1f( programs_->streaming.uniform_location( "halfwidth" ), width / 2 );
+
+  /* draw the live segments (at most two runs of slots), then the tail */
+  const size_t segments = samples.size() - 1;
+  const size_t first_slot = samples.physical_index( 0 );
+  const size_t first_count = min( segments, stream_.capacity - first_slot );
+
+  if ( first_count ) {
+    glDrawArrays( GL_TRIANGLES, first_slot * stream_vertices_per_segment,
+		  first_count * stream_vertices_per_segment );
+  }
+
+  if ( segments > first_count ) {
+    glDrawArrays( GL_TRIANGLES, 0, (segments - first_count) * stream_vertices_per_segment );
+  }
+
+  glDrawArrays( GL_TRIANGLES, tail_first, stream_tail_vertices );
+  GLState::submitted( segments * stream_vertices_per_segment + stream_tail_vertices );
+}
+
+void Display::point_instanced_attributes( const size_t first_slot )
+{
+  /* each instance reads sample (first_slot + i) as its start and the next one as its end */
+  ArrayBuffer::bind( instanced_.times );
+  glVertexAttribPointer( programs_->instanced.attribute_location( "start_t" ), 1, GL_FLOAT, GL_FALSE, 0,
+			 reinterpret_cast<const GLvoid *>( first_slot * sizeof( float ) ) );
+  glVertexAttribPointer( programs_->instanced.attribute_location( "end_t" ), 1, GL_FLOAT, GL_FALSE, 0,
+			 reinterpret_cast<const GLvoid *>( (first_slot + 1) * sizeof( float ) ) );
+
+  ArrayBuffer::bind( instanced_.values );
+  glVertexAttribPointer( programs_->instanced.attribute_location( "start_y" ), 1, GL_UNSIGNED_SHORT, GL_TRUE, 0,
+			 reinterpret_cast<const GLvoid *>( first_slot * sizeof( uint16_t ) ) );
+  glVertexAttribPointer( programs_->instanced.attribute_location( "end_y" ), 1, GL_UNSIGNED_SHORT, GL_TRUE, 0,
+			 reinterpret_cast<const GLvoid *>( (first_slot + 1) * sizeof( uint16_t ) ) );
+}
+
+void Display::draw_instanced( const float width, const SampleRing & samples,
+			      const float extension_time, const AffineTransform & transform )
+{
+  ScopedTimer timer( profiler_, Profiler::Geometry );
+
+  const uint64_t first_live = samples.pushed() - samples.size();
+  const size_t capacity = samples.capacity();
+  const ValueRange visible = visible_values( transform, width / 2 + feather() );
+
+  instanced_.array_object.bind();
+
+  /* (re)allocate: ring slots, mirror of slot 0, and two tail slots */
+  if ( (not instanced_.valid)
+       or (instanced_.capacity != capacity)
+       or (not instanced_.range.suits( visible ))
+       or (instanced_.source != &samples)
+       or (samples.pushed() < instanced_.uploaded)
+       or (samples.front_time() - instanced_.epoch > epoch_lifetime) ) {
+    if ( instanced_.capacity != capacity ) {
+      instanced_.capacity = capacity;
+      ArrayBuffer::bind( instanced_.times );
+      ArrayBuffer::allocate( (capacity + 3) * sizeof( float ), GL_DYNAMIC_DRAW );
+      ArrayBuffer::bind( instanced_.values );
+      ArrayBuffer::allocate( (capacity + 3) * sizeof( uint16_t ), GL_DYNAMIC_DRAW );
+    }
+
+    instanced_.range = ValueRange::around( visible );
+    instanced_.epoch = samples.front_time();
+    instanced_.source = &samples;
+    instanced_.uploaded = first_live;
+    instanced_.valid = true;
+  }
+
+  /* upload the new samples: times relative to the epoch, values encoded */
+  uint64_t next = max( instanced_.uploaded, first_live );
+  while ( next < samples.pushed() ) {
+    const size_t slot = samples.physical_index( next - first_live );
+    const size_t count = min<uint64_t>( samples.pushed() - next, capacity - slot );
+    const auto spans = samples.spans();
+    const SampleRing::Span & span = slot >= spans.first.offset ? spans.first : spans.second;
+    const size_t index_in_span = slot - span.offset;
+
+    ArrayBuffer::bind( instanced_.times );
+    float * times = static_cast<float *>(
+      ArrayBuffer::map_range( slot * sizeof( float ), count * sizeof( float ),
+			      GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT ) );
+    for ( size_t i = 0; i < count; i++ ) {
+      times[ i ] = span.times[ index_in_span + i ] - instanced_.epoch;
+    }
+    ArrayBuffer::unmap();
+
+    ArrayBuffer::bind( instanced_.values );
+    uint16_t * values = static_cast<uint16_t *>(
+      ArrayBuffer::map_range( slot * sizeof( uint16_t ), count * sizeof( uint16_t ),
+			      GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT ) );
+    for ( size_t i = 0; i < count; i++ ) {
+      values[ i ] = instanced_.range.quantize( span.values[ index_in_span + i ] );
+    }
+    ArrayBuffer::unmap();
+
+    /* keep the mirror of slot 0 current */
+    if ( slot == 0 ) {
+      const float mirror_time = span.times[ 0 ] - instanced_.epoch;
+      const uint16_t mirror = instanced_.range.quantize( span.values[ 0 ] );
+      ArrayBuffer::bind( instanced_.times );
+      ArrayBuffer::load_range( capacity * sizeof( float ), sizeof( mirror_time ), &mirror_time );
+      ArrayBuffer::bind( instanced_.values );
+      ArrayBuffer::load_range( capacity * sizeof( uint16_t ), sizeof( mirror ), &mirror );
+    }
+
+    next += count;
+  }
+  instanced_.uploaded = samples.pushed();
+
+  /* the tail segment runs from the last sample out to the extension time */
+  const float tail_times[ 2 ] = { samples.back_time() - instanced_.epoch, extension_time - instanced_.epoch };
+  const uint16_t last_value = instanced_.range.quantize( samples.back_value() );
+  const uint16_t tail_values[ 2 ] = { last_value, last_value };
+  ArrayBuffer::bind( instanced_.times );
+  ArrayBuffer::load_range( (capacity + 1) * sizeof( float ), sizeof( tail_times ), tail_times );
+  ArrayBuffer::bind( instanced_.values );
+  ArrayBuffer::load_range( (capacity + 1) * sizeof( uint16_t ), sizeof( tail_values ), tail_values );
+
+  timer.next( Profiler::Submit );
+
+  const AffineTransform instanced_transform = encoded( transform, instanced_.range );
+  glUniform2f( programs_->instanced.uniform_location( "scale" ),
+	       instanced_transform.x_scale, instanced_transform.y_scale );
+  glUniform2f( programs_->instanced.uniform_location( "offset" ),
+	       instanced_transform.x_offset + instanced_.epoch * instanced_transform.x_scale,
+	       instanced_transform.y_offset );
+  glUniform1f( programs_->instanced.uniform_location( "halfwidth" ), width / 2 );
+  glUniform1f( programs_->instanced.uniform_location( "feather" ), feather() );
+
+  /* draw the live segments (at most two runs of slots) */
+  const size_t segments = samples.size() - 1;
+  const size_t first_slot = samples.physical_index( 0 );
+  const size_t first_count = min( segments, capacity - first_slot );
+
+  if ( first_count ) {
+    point_instanced_attributes( first_slot );
+    glDrawArraysInstanced( GL_TRIANGLES, 0, 12, first_count );
+  }
+
+  if ( segments > first_count ) {
+    point_instanced_attributes( 0 );
+    glDrawArraysInstanced( GL_TRIANGLES, 0, 12, segments - first_count );
+  }
+
+  /* then the tail, with the square capping its end */
+  point_instanced_attributes( capacity + 1 );
+  glDrawArraysInstanced( GL_TRIANGLES, 0, 18, 1 );
+  GLState::submitted( 12 * segments + 18 );
 }
 
 void Display::clear( void )
 {
   glClear( GL_COLOR_BUFFER_BIT );
 }
+
+void Display::draw_batch( const vector<Series> & series,
+			  const float cutoff,
+			  const float extension_time,
+			  const AffineTransform & transform )
+{
+  if ( series.size() > max_batch_series ) {
+    throw runtime_error( "too many series to draw in one batch" );
+  }
+
+  ScopedTimer timer( profiler_, Profiler::Geometry );
+
+  /* how much room the packed samples might need */
+  vector<size_t> reduced_bounds;
+  size_t needed = 0;
+  for ( const auto & x : series ) {
+    reduced_bounds.push_back( decimation_ ? reduced_size_bound( *x.samples, transform ) : 0 );
+    if ( not x.samples->empty() ) {
+      needed += (reduced_bounds.back() ? reduced_bounds.back() : x.samples->size()) + 1;
+    }
+  }
+
+  if ( needed < 2 ) {
+    return;
+  }
+
+  GpuTimer::Scope gpu_timer( gpu_timer_.get(), Profiler::Lines );
+
+  batch_.array_object.bind();
+  ArrayBuffer::bind( batch_.samples );
+
+  if ( batch_.capacity < needed ) {
+    batch_.capacity = max<size_t>( batch_.capacity, 1024 );
+    while ( batch_.capacity < needed ) {
+      batch_.capacity *= 2;
+    }
+    ArrayBuffer::allocate( batch_.capacity * sizeof( BatchSample ), GL_STREAM_DRAW );
+  }
+
+  /* pack every series, then its extension, into one freshly orphaned buffer
+     (rebuilt every frame, so encoded against a range around this view) */
+  float widest = 0;
+  for ( const auto & x : series ) {
+    widest = max( widest, x.width );
+  }
+
+  const ValueRange range = ValueRange::around( visible_values( transform, widest / 2 + feather() ) );
+  const float origin = extension_time;
+
+  BatchSample * const first = static_cast<BatchSample *>(
+    ArrayBuffer::map_range( 0, needed * sizeof( BatchSample ),
+			    GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT ) );
+  BatchSample * out = first;
+
+  for ( size_t i = 0; i < series.size(); i++ ) {
+    const SampleRing & samples = *series[ i ].samples;
+    if ( samples.empty() ) {
+      continue;
+    }
+
+    const uint8_t index = i;
+    const auto emit = [&] ( const float t, const float y ) {
+      *out++ = BatchSample( { t - origin, range.quantize( y ), index, 0 } );
+    };
+
+    if ( reduced_bounds[ i ] ) {
+      reduce_columns( samples, transform, reduced_bounds[ i ], emit );
+    } else {
+      const auto spans = samples.spans();
+      for ( const SampleRing::Span & span : { spans.first, spans.second } ) {
+	for ( size_t j = 0; j < span.length; j++ ) {
+	  emit( span.times[ j ], span.values[ j ] );
+	}
+      }
+    }
+
+    *out++ = BatchSample( { 0, range.quantize( samples.back_value() ), index, 1 } );
+  }
+
+  ArrayBuffer::unmap();
+  const size_t count = out - first;
+
+  /* colors and half-widths, as laid out by std140 */
+  float styles[ 2 ][ max_batch_series ][ 4 ] = {};
+  for ( size_t i = 0; i < series.size(); i++ ) {
+    styles[ 0 ][ i ][ 0 ] = series[ i ].red;
+    styles[ 0 ][ i ][ 1 ] = series[ i ].green;
+    styles[ 0 ][ i ][ 2 ] = series[ i ].blue;
+    styles[ 0 ][ i ][ 3 ] = series[ i ].alpha;
+    styles[ 1 ][ i ][ 0 ] = series[ i ].width / 2;
+  }
+
+  UniformBuffer::bind( batch_.styles );
+  UniformBuffer::load_range( 0, sizeof( styles ), styles );
+
+  timer.next( Profiler::Submit );
+
+  programs_->batch.use();
+  UniformBuffer::bind_base( batch_.styles, 0 );
+  const AffineTransform batch_transform = encoded( transform, range );
+  glUniform2f( programs_->batch.uniform_location( "scale" ),
+	       batch_transform.x_scale, batch_transform.y_scale );
+  glUniform2f( programs_->batch.uniform_location( "offset" ),
+	       batch_transform.x_offset + origin * batch_transform.x_scale, batch_transform.y_offset );
+  glUniform1f( programs_->batch.uniform_location( "cutoff" ), cutoff );
+  glUniform1f( programs_->batch.uniform_location( "feather" ), feather() );
+
+  glDrawArraysInstanced( GL_TRIANGLES, 0, 18, count - 1 );
+  GLState::submitted( 18 * (count - 1) );
+}
+
+void Display::draw_text( const vector<TextQuad> & quads, Texture & atlas,
+			 const float red, const float green, const float blue )
+{
+  if ( quads.empty() ) {
+    return;
+  }
+
+  ScopedTimer timer( profiler_, Profiler::Submit );
+  GpuTimer::Scope gpu_timer( gpu_timer_.get(), Profiler::Text );
+
+  text_.array_object.bind();
+  ArrayBuffer::bind( text_.quads );
+
+  /* orphan and refill, growing by doubling */
+  if ( text_.capacity < quads.size() ) {
+    text_.capacity = max( quads.size(), 2 * text_.capacity );
+  }
+  ArrayBuffer::allocate( text_.capacity * sizeof( TextQuad ), GL_STREAM_DRAW );
+  ArrayBuffer::load_range( 0, quads.size() * sizeof( TextQuad ), quads.data() );
+
+  programs_->text.use();
+  atlas.bind();
+  glUniform3f( programs_->text.uniform_location( "color" ), red, green, blue );
+
+  glDrawArraysInstanced( GL_TRIANGLE_FAN, 0, 4, quads.size() );
+  GLState::submitted( 4 * quads.size() );
+}
@@ -1,32 +1,122 @@
 #ifndef DISPLAY_HH
 #define DISPLAY_HH
 
-#include <deque>
 #include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
 
 #include "gl_objects.hh"
+#include "sample_ring.hh"
+#include "profiler.hh"
+
+/* maps (time, value) to window pixel coordinates */
+struct AffineTransform
+{
+  double x_scale, x_offset, y_scale, y_offset;
+
+  std::pair<float, float> operator()( const std::pair<float, float> & x ) const
+  {
+    return std::make_pair( x.first * x_scale + x_offset, x.second * y_scale + y_offset );
+  }
+};
+
+class SharedContext;
+class VideoWriter;
 
 class Display
 {
+public:
+  enum class LineMode { Immediate, Streaming, Instanced };
+
+  /* how line edges are smoothed: by drawing into a 4x multisampled
+     framebuffer (which every fragment pays for, the overlay's included),
+     or analytically, by fading each line's edge pixels out by their
+     coverage (which only the lines' edges pay for, with no multisampling
+     at all). analytic lines are always drawn in the instanced mode
+     (for a single series), where the shader knows each segment's edges. */
+  enum class Antialiasing { Multisample, Analytic };
+
+private:
   static const std::string shader_source_scale_from_pixel_coordinates;
+  static const std::string shader_source_scale_from_data_coordinates;
+  static const std::string shader_source_step_segment_instance;
+  static const std::string shader_source_step_segment_batch;
   static const std::string shader_source_passthrough_texture;
   static const std::string shader_source_solid_color;
+  static const std::string shader_source_solid_color_coverage;
+  static const std::string shader_source_series_color;
+  static const std::string shader_source_text_glyph;
+  static const std::string shader_source_sdf_text;
+
+public:
+  /* every shader program, compiled and linked once per share group of
+     contexts (a display makes its own unless given some to share) */
+  struct Programs
+  {
+    VertexShader scale_from_pixel_coordinates = { shader_source_scale_from_pixel_coordinates };
+    FragmentShader passthrough_texture = { shader_source_passthrough_texture };
+    VertexShader scale_from_data_coordinates = { shader_source_scale_from_data_coordinates };
+    VertexShader step_segment_instance = { shader_source_step_segment_instance };
+    VertexShader step_segment_batch = { shader_source_step_segment_batch };
+    FragmentShader solid_color_fragment = { shader_source_solid_color };
+    FragmentShader solid_color_coverage = { shader_source_solid_color_coverage };
+    FragmentShader series_color = { shader_source_series_color };
+    VertexShader text_glyph = { shader_source_text_glyph };
+    FragmentShader sdf_text = { shader_source_sdf_text };
 
+    Program texture = {};
+    Program solid_color = {};
+    Program streaming = {};
+    Program instanced = {};
+    Program batch = {};
+    Program text = {};
+
+    /* uniforms belong to the program, so they hold the window size of
+       whichever display last set them */
+    const Display * window_size_owner = nullptr;
+
+    Programs();
+
+    /* forbid copy */
+    Programs( const Programs & other ) = delete;
+    Programs & operator=( const Programs & other ) = delete;
+  };
+
+private:
   struct CurrentContextWindow
   {
     GLFWContext glfw_context_ = {};
     Window window_;
 
     CurrentContextWindow( const unsigned int width, const unsigned int height,
-			  const std::string & title );
+			  const std::string & title, const bool visible, const Window * const share,
+			  const unsigned int samples );
   } current_context_window_;
 
-  VertexShader scale_from_pixel_coordinates_ = { shader_source_scale_from_pixel_coordinates };
-  FragmentShader passthrough_texture_ = { shader_source_passthrough_texture };
-  FragmentShader solid_color_ = { shader_source_solid_color };
+  /* when offscreen, everything is drawn into a multisampled framebuffer
+     object (resolved on swap) instead of the (invisible) window; with
+     analytic antialiasing, it has a single sample and is just copied */
+  struct Offscreen
+  {
+    std::pair<unsigned int, unsigned int> size;
+
+    Renderbuffer multisample_color = {};
+    Renderbuffer resolved_color = {};
 
-  Program texture_shader_program_ = {};
-  Program solid_color_shader_program_ = {};
+    Framebuffer multisample = {};
+    Framebuffer resolved = {};
+
+    Offscreen( const unsigned int width, const unsigned int height, const unsigned int samples );
+  };
+
+  std::unique_ptr<Offscreen> offscreen_;
+
+  std::shared_ptr<Programs> programs_;
+
+  /* what the viewport and the programs' window_size were last set to */
+  std::pair<unsigned int, unsigned int> viewport_size_ = { 0, 0 };
+  void set_window_size_uniforms( void );
 
   Texture texture_;
 
@@ -36,16 +126,219 @@ class Display
   VertexBufferObject screen_corners_ = {};
   VertexBufferObject other_vertices_ = {};
 
+  LineMode line_mode_ = LineMode::Immediate;
+  Antialiasing antialiasing_ = Antialiasing::Multisample;
+
+  /* width (in pixels) of the edge over which analytic lines fade out, or 0 */
+  float feather( void ) const { return antialiasing_ == Antialiasing::Analytic ? 1 : 0; }
+
+  Profiler * profiler_ = nullptr;
+  bool synchronous_swap_ = false;
+
+  int swap_interval_ = -1;     /* wanted */
+  int set_swap_interval_ = -1; /* as last set on the context */
+
+  /* only while profiling */
+  std::unique_ptr<GpuTimer> gpu_timer_ = nullptr;
+  std::vector<GpuTimer::Result> gpu_results_ = {};
+
+  /* only while recording: each frame is read back through the ring and
+     handed to the writer once it arrives */
+  VideoWriter * video_writer_ = nullptr;
+  std::unique_ptr<PixelPackRing> pixel_pack_ring_ = nullptr;
+
+  bool collect_frame( const bool wait );
+
+  /* the line's vertices carry each value as a 16-bit fraction of a
+     range several times taller than what is visible, and centered on
+     it, which the scale and offset uniforms map back along with
+     everything else. so autoscaling, like scrolling, changes only the
+     uniforms, until the view leaves the range or zooms far into it and
+     the vertices are encoded afresh. values beyond the range are
+     clamped, which only moves line ends that are off screen anyway:
+     the view a range must cover reaches past the window by the line's
+     half-width, so a line clamped to the range's edge stays out of sight. */
+  struct ValueRange
+  {
+    float bottom, span;
+
+    uint16_t quantize( const float y ) const;
+
+    /* can vertices encoded against this range draw this view, precisely enough? */
+    bool suits( const ValueRange & visible ) const;
+
+    /* the range to encode against for this view */
+    static ValueRange around( const ValueRange & visible );
+  };
+
+  /* the values between the top and bottom of the window, and margin pixels beyond each */
+  ValueRange visible_values( const AffineTransform & transform, const float margin ) const;
+
+  /* the transform for values encoded against range (as normalized attributes) */
+  static AffineTransform encoded( const AffineTransform & transform, const ValueRange & range );
+
+  /* in streaming mode, each segment of the line is uploaded once, into
+     the slot matching the physical index of its first sample in the
+     SampleRing. vertices hold (time - epoch, encoded value) plus the
+     direction of their offset from it, and the vertex shader applies
+     the current scroll, scale and line width. */
+  struct StreamVertex
+  {
+    float t;
+    uint16_t y;
+    int8_t dx, dy;
+  };
+
+  static constexpr unsigned int stream_vertices_per_segment = 12;
+  static constexpr unsigned int stream_tail_vertices = stream_vertices_per_segment + 6;
+
+  struct Stream
+  {
+    VertexArrayObject array_object = {};
+    VertexBufferObject vertices = {};
+
+    size_t capacity = 0;        /* segment slots (== SampleRing capacity) */
+    uint64_t uploaded = 0;      /* samples whose incoming segment is on the GPU */
+    float epoch = 0;
+    ValueRange range = { 0, 0 };
+    bool y_flipped = false;
+    const SampleRing * source = nullptr;
+    bool valid = false;
+  } stream_ = {};
+
+  /* in instanced mode, only the samples go to the GPU, each a float
+     time and an encoded value, in two buffers laid out like the SampleRing
+     (plus a mirror of slot 0 after the end, so the segment that wraps
+     can read its end sample, and two tail slots for the extension).
+     times are relative to an epoch, re-based like the stream's. each
+     instance is one segment; the vertex shader expands it. */
+  struct Instanced
+  {
+    VertexArrayObject array_object = {};
+    VertexBufferObject times = {};
+    VertexBufferObject values = {};
+
+    size_t capacity = 0;
+    uint64_t uploaded = 0;      /* samples on the GPU */
+    ValueRange range = { 0, 0 };
+    float epoch = 0;            /* times are uploaded relative to this */
+    const SampleRing * source = nullptr;
+    bool valid = false;
+  } instanced_ = {};
+
+  /* when there are many more samples than pixel columns, each draw
+     first reduces every column to its first, minimum, maximum and last
+     samples (M4), which renders the same as the full data */
+  bool decimation_ = true;
+  SampleRing decimated_ = { 1 };
+
+  const SampleRing & decimate( const SampleRing & samples, const AffineTransform & transform );
+
+  void point_instanced_attributes( const size_t first_slot );
+
+  /* several series drawn at once: every series' samples (then its
+     extension) packed into one buffer, each tagged with its series,
+     with times relative to the extension's (the frame's origin).
+     instance i is the segment from sample i to sample i + 1, dropped by
+     the shader if they belong to different series; colors and widths
+     come from a uniform block. */
+  struct BatchSample
+  {
+    float t;
+    uint16_t y;
+    uint8_t series, cap;
+  };
+
+  struct Batch
+  {
+    VertexArrayObject array_object = {};
+    VertexBufferObject samples = {};
+    VertexBufferObject styles = {};
+
+    size_t capacity = 0;        /* BatchSamples */
+  } batch_ = {};
+
+  /* text: one instance per glyph quad, drawn from a signed-distance-field atlas */
+  struct Text
+  {
+    VertexArrayObject array_object = {};
+    VertexBufferObject quads = {};
+
+    size_t capacity = 0;        /* TextQuads */
+  } text_ = {};
+
+  static StreamVertex * stream_segment( StreamVertex * out,
+					const float start_t, const float start_y,
+					const float end_t, const float end_y,
+					const ValueRange & range, const bool y_flipped );
+
+  void draw_immediate( const float width, const SampleRing & samples,
+		       const float extension_time, const AffineTransform & transform );
+  void draw_streaming( const float width, const SampleRing & samples,
+		       const float extension_time, const AffineTransform & transform );
+  void draw_instanced( const float width, const SampleRing & samples,
+		       const float extension_time, const AffineTransform & transform );
+
 public:
   Display( const unsigned int width, const unsigned int height,
-	   const std::string & title );
+	   const std::string & title, const bool offscreen = false,
+	   const Antialiasing antialiasing = Antialiasing::Multisample );
+
+  /* a display whose context shares objects with the shared context, and uses its
+     programs (or, if null, that makes its own context and programs like the above) */
+  Display( SharedContext * const shared, const unsigned int width, const unsigned int height,
+	   const std::string & title, const bool offscreen = false,
+	   const Antialiasing antialiasing = Antialiasing::Multisample );
+
+  ~Display();
+
+  /* make this display's context current, so it can be drawn into (drawing
+     into any other display makes its own current) */
+  void make_current( void );
 
   void draw( const Image & image );
+
+  /* blit a window-sized layer over what's already drawn. the layer is
+     sampled at (x + scroll_x) mod its width; premultiplied layers (as
+     Cairo produces) may be transparent. */
+  void composite( Texture & layer, const bool premultiplied, const float scroll_x = 0 );
   void draw( const float red, const float green, const float blue, const float alpha,
 	     const float width,
 	     const float cutoff,
-	     const std::deque<std::pair<float, float>> & vertices,
-	     const std::function<std::pair<float, float>(const std::pair<float, float> &)> & transform );
+	     const SampleRing & samples,
+	     const float extension_time,
+	     const AffineTransform & transform );
+
+  /* one of the series drawn together by draw_batch() */
+  struct Series
+  {
+    const SampleRing * samples;
+    float red, green, blue, alpha;
+    float width;
+  };
+
+  static constexpr unsigned int max_batch_series = 64; /* must match the batch shader */
+
+  /* draw every series with one upload and one draw call (always instanced) */
+  void draw_batch( const std::vector<Series> & series,
+		   const float cutoff,
+		   const float extension_time,
+		   const AffineTransform & transform );
+
+  /* one glyph of a label, for draw_text() */
+  struct TextQuad
+  {
+    float x, y, width, height;      /* pixels from the label's center, before rotation */
+    float u, v, u_width, v_height;  /* texels of the atlas */
+    float center_x, center_y;       /* where the label goes, in window pixels */
+    float angle;                    /* radians, as cairo_rotate() */
+    float alpha;
+  };
+
+  /* draw glyphs from a signed-distance-field atlas (see SdfAtlas) in one instanced call */
+  void draw_text( const std::vector<TextQuad> & quads, Texture & atlas,
+		  const float red, const float green, const float blue );
+
   void clear( void );
 
   void repaint( void );
@@ -53,8 +346,69 @@ public:
   void swap( void );
 
   const Window & window( void ) const { return current_context_window_.window_; }
+  Window & window( void ) { return current_context_window_.window_; }
+
+  /* size of what we draw into: the window's framebuffer, or the offscreen one */
+  std::pair<unsigned int, unsigned int> size( void ) const;
+
+  bool offscreen( void ) const { return offscreen_ != nullptr; }
+
+  /* seconds between the refreshes swap() waits for, or 0 if it doesn't wait */
+  double refresh_interval( void ) const;
+
+  /* copy the last swapped frame (offscreen only), top row first */
+  void read_frame( Image & image );
 
   void resize( const std::pair<unsigned int, unsigned int> & target_size );
+
+  void set_line_mode( const LineMode mode ) { line_mode_ = mode; }
+  Antialiasing antialiasing( void ) const { return antialiasing_; }
+  LineMode line_mode( void ) const { return line_mode_; }
+
+  void set_decimation( const bool enabled ) { decimation_ = enabled; }
+
+  /* profiling also times each pass on the GPU, and counts vertices and uploads */
+  void set_profiler( Profiler * const profiler );
+
+  /* how many refreshes swap() waits for: 1 (the default onscreen) or 0 */
+  void set_swap_interval( const int interval ) { swap_interval_ = interval; }
+
+  /* offscreen, pass every frame swapped to writer (null stops, after
+     passing on the frames still being read back) */
+  void set_video_writer( VideoWriter * const writer );
+
+  /* wait for the GPU to finish each frame in swap(), so its cost shows up there */
+  void set_synchronous_swap( const bool synchronous ) { synchronous_swap_ = synchronous; }
+
+  /* forbid copy */
+  Display( const Display & other ) = delete;
+  Display & operator=( const Display & other ) = delete;
+};
+
+/* a hidden window whose context the displays made from this share
+   objects with, and the programs compiled there once for all of them.
+   must outlive those displays. */
+class SharedContext
+{
+  friend class Display;
+
+  struct Root
+  {
+    GLFWContext glfw_context = {};
+    Window window;
+
+    Root();
+  } root_;
+
+  std::shared_ptr<Display::Programs> programs_;
+
+public:
+  SharedContext();
+  ~SharedContext();
+
+  /* forbid copy */
+  SharedContext( const SharedContext & other ) = delete;
+  SharedContext & operator=( const SharedContext & other ) = delete;
 };
 
 #endif /* DISPLAY_HH */
@@ -0,0 +1,89 @@
+#include <thread>
+#include <algorithm>
+#include <cmath>
+
+#include "frame_scheduler.hh"
+
+using namespace std;
+
+/* latency mode's render budget: where it starts and the bounds it adapts between */
+static const double initial_budget_fraction = 0.5;
+static const double minimum_budget = 0.001;
+
+/* and how it adapts: grow quickly after a miss, shrink slowly after a success */
+static const double miss_growth = 1.5;
+static const double success_decay = 0.99;
+
+FrameScheduler::FrameScheduler( const Mode mode, const double refresh_interval )
+  : mode_( mode ),
+    refresh_interval_( refresh_interval ),
+    start_( Clock::now() ),
+    last_present_( start_ ),
+    deadline_( start_ ),
+    presented_( false ),
+    render_budget_( max( minimum_budget, refresh_interval * initial_budget_fraction ) ),
+    fixed_frames_( 0 ),
+    statistics_( { 0, 0, 0, 0, 0 } )
+{
+  statistics_.render_budget = mode_ == Mode::Latency ? render_budget_ : 0;
+}
+
+double FrameScheduler::begin_frame( void )
+{
+  if ( mode_ == Mode::Fixed ) {
+    return fixed_frames_++ * refresh_interval_;
+  }
+
+  if ( refresh_interval_ > 0 and presented_ ) {
+    /* aim for the refresh after the one the last frame was presented at */
+    deadline_ = last_present_ + duration( refresh_interval_ );
+
+    if ( mode_ == Mode::Latency ) {
+      this_thread::sleep_until( deadline_ - duration( render_budget_ ) );
+    }
+  }
+
+  return seconds( Clock::now() - start_ );
+}
+
+double FrameScheduler::now( void ) const
+{
+  if ( mode_ == Mode::Fixed ) {
+    return fixed_frames_ * refresh_interval_;
+  }
+
+  return seconds( Clock::now() - start_ );
+}
+
+void FrameScheduler::end_frame( const bool presented )
+{
+  if ( not presented ) {
+    presented_ = false;
+    return;
+  }
+
+  const Clock::time_point now = Clock::now();
+  statistics_.frames++;
+
+  if ( refresh_interval_ > 0 and presented_ and mode_ != Mode::Fixed ) {
+    /* the swap returns at a refresh; which one, relative to the deadline? */
+    const double late = seconds( now - deadline_ );
+    const double refreshes_late = floor( late / refresh_interval_ + 0.5 );
+
+    if ( refreshes_late >= 1 ) {
+      statistics_.missed++;
+      statistics_.skipped += refreshes_late;
+      statistics_.worst_late = max( statistics_.worst_late, late );
+      render_budget_ = min( refresh_interval_, render_budget_ * miss_growth );
+    } else {
+      render_budget_ = max( minimum_budget, render_budget_ * success_decay );
+    }
+
+    if ( mode_ == Mode::Latency ) {
+      statistics_.render_budget = render_budget_;
+    }
+  }
+
+  last_present_ = now;
+  presented_ = true;
+}
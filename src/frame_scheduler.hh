@@ -0,0 +1,79 @@
+#ifndef FRAME_SCHEDULER_HH
+#define FRAME_SCHEDULER_HH
+
+#include <chrono>
+#include <cstdint>
+
+/* paces frames by a monotonic clock. each frame is drawn for the time
+   it begins at, so the plot keeps up with real time, and a frame that
+   runs long just means the frames it overlapped are never drawn.
+
+   with vsync, the buffer swap blocks until the next refresh and each
+   frame begins as soon as the last one is presented. in latency mode,
+   each frame instead begins as late as it can and still make the next
+   refresh, so what it shows is as fresh as possible when it appears.
+   the time that takes is learned from the deadlines missed and made.
+
+   in fixed mode, nothing waits: each frame is drawn for the next
+   multiple of the interval, for rendering video faster than real time. */
+class FrameScheduler
+{
+public:
+  enum class Mode { Vsync, Latency, Fixed };
+
+  struct Statistics
+  {
+    uint64_t frames;
+    uint64_t missed;      /* frames presented later than the refresh they were meant for */
+    uint64_t skipped;     /* refreshes that showed no new frame */
+    double worst_late;    /* seconds, the latest a frame was presented */
+    double render_budget; /* seconds, what latency mode currently allows to draw a frame */
+  };
+
+private:
+  typedef std::chrono::steady_clock Clock;
+
+  Mode mode_;
+  double refresh_interval_;
+
+  Clock::time_point start_;
+  Clock::time_point last_present_;
+  Clock::time_point deadline_;
+  bool presented_;
+
+  double render_budget_;
+
+  uint64_t fixed_frames_; /* begun, in fixed mode */
+
+  Statistics statistics_;
+
+  static double seconds( const Clock::duration & duration )
+  {
+    return std::chrono::duration<double>( duration ).count();
+  }
+
+  static Clock::duration duration( const double seconds )
+  {
+    return std::chrono::duration_cast<Clock::duration>( std::chrono::duration<double>( seconds ) );
+  }
+
+public:
+  /* refresh_interval is the display's (in seconds), or 0 if there isn't one
+     to wait for; in fixed mode, it is the time between frames */
+  FrameScheduler( const Mode mode, const double refresh_interval );
+
+  /* wait until it's time to draw, then return the time to draw for, in seconds since the start */
+  double begin_frame( void );
+
+  /* the time now, on the same clock, without beginning a frame (in fixed
+     mode, the time the next frame will be drawn for) */
+  double now( void ) const;
+
+  /* the frame just drawn has been swapped (or, if not presented, it was
+     skipped and the next frame is paced afresh) */
+  void end_frame( const bool presented = true );
+
+  const Statistics & statistics( void ) const { return statistics_; }
+};
+
+#endif /* FRAME_SCHEDULER_HH */
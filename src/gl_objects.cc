@@ -1,17 +1,90 @@
 #include <iostream>
 #include <stdexcept>
 #include <memory>
+#include <algorithm>
+#include <limits>
 
 #include "gl_objects.hh"
 #include "image.hh"
 
 using namespace std;
 
+static const size_t binding_count = static_cast<size_t>( GLState::Binding::count );
+
+/* 0 is never a name GL hands out, and binding it means "nothing"; so a
+   binding known to hold nothing useful is marked with this instead */
+static const GLuint unknown_binding = numeric_limits<GLuint>::max();
+
+static GLuint bound[ binding_count ] = { unknown_binding, unknown_binding, unknown_binding,
+					 unknown_binding, unknown_binding };
+static GLState::Counters current_counters = { 0, 0, 0, 0 }, last_counters = { 0, 0, 0, 0 };
+
+bool GLState::bind( const Binding binding, const GLuint num )
+{
+  GLuint & slot = bound[ static_cast<size_t>( binding ) ];
+  if ( slot == num ) {
+    current_counters.elided++;
+    return false;
+  }
+
+  slot = num;
+  current_counters.calls++;
+  return true;
+}
+
+void GLState::forget( const Binding binding, const GLuint num )
+{
+  GLuint & slot = bound[ static_cast<size_t>( binding ) ];
+  if ( slot == num ) {
+    slot = unknown_binding;
+  }
+}
+
+void GLState::invalidate( void )
+{
+  fill( begin( bound ), end( bound ), unknown_binding );
+}
+
+void GLState::elided( void )
+{
+  current_counters.elided++;
+}
+
+void GLState::uploaded( const uint64_t bytes )
+{
+  current_counters.uploaded += bytes;
+}
+
+void GLState::submitted( const uint64_t vertices )
+{
+  current_counters.vertices += vertices;
+}
+
+GLState::Counters GLState::frame( void )
+{
+  return current_counters;
+}
+
+GLState::Counters GLState::last_frame( void )
+{
+  return last_counters;
+}
+
+void GLState::end_frame( void )
+{
+  last_counters = current_counters;
+  current_counters = { 0, 0, 0, 0 };
+}
+
+unsigned int GLFWContext::count_ = 0;
+
 GLFWContext::GLFWContext()
 {
-  glfwSetErrorCallback( error_callback );
+  if ( count_++ == 0 ) {
+    glfwSetErrorCallback( error_callback );
 
-  glfwInit();
+    glfwInit();
+  }
 }
 
 void GLFWContext::error_callback( const int, const char * const description )
@@ -21,30 +94,88 @@ void GLFWContext::error_callback( const int, const char * const description )
 
 GLFWContext::~GLFWContext()
 {
-  glfwTerminate();
+  if ( --count_ == 0 ) {
+    glfwTerminate();
+  }
 }
 
-Window::Window( const unsigned int width, const unsigned int height, const string & title )
-  : window_()
+Window::Window( const unsigned int width, const unsigned int height, const string & title,
+		const bool visible, const Window * const share, const unsigned int samples )
+  : window_(),
+    iconified_( false ),
+    damaged_( false )
 {
   glfwDefaultWindowHints();
 
   glfwWindowHint( GLFW_CONTEXT_VERSION_MAJOR, 3 );
-  glfwWindowHint( GLFW_CONTEXT_VERSION_MINOR, 1 );
+  glfwWindowHint( GLFW_CONTEXT_VERSION_MINOR, 3 ); /* for instanced arrays */
+  glfwWindowHint( GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE );
   glfwWindowHint( GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE );
-  glfwWindowHint( GLFW_SAMPLES, 4 );
+  glfwWindowHint( GLFW_SAMPLES, samples );
   glfwWindowHint( GLFW_RESIZABLE, GL_TRUE );
+  glfwWindowHint( GLFW_VISIBLE, visible ? GL_TRUE : GL_FALSE );
   //  glfwWindowHint( GLFW_ALPHA_BITS, 0 );
 
-  window_.reset( glfwCreateWindow( width, height, title.c_str(), nullptr, nullptr ) );
+  window_.reset( glfwCreateWindow( width, height, title.c_str(), nullptr,
+				  share ? share->window_.get() : nullptr ) );
   if ( not window_.get() ) {
     throw runtime_error( "could not create window" );
   }
+
+  glfwSetWindowUserPointer( window_.get(), this );
+  glfwSetWindowIconifyCallback( window_.get(), iconify_callback );
+  glfwSetWindowRefreshCallback( window_.get(), refresh_callback );
+}
+
+void Window::iconify_callback( GLFWwindow * window, const int iconified )
+{
+  Window * self = static_cast<Window *>( glfwGetWindowUserPointer( window ) );
+  self->iconified_ = iconified;
+  self->damaged_ = true;
+}
+
+void Window::refresh_callback( GLFWwindow * window )
+{
+  static_cast<Window *>( glfwGetWindowUserPointer( window ) )->damaged_ = true;
+}
+
+bool Window::take_damage( void )
+{
+  const bool ret = damaged_;
+  damaged_ = false;
+  return ret;
+}
+
+void Window::wait_events( const double timeout )
+{
+  glfwWaitEventsTimeout( timeout );
+}
+
+void EventWakeup::post( void )
+{
+  /* glfwPostEmptyEvent is safe from any thread (while GLFW is initialized) */
+  if ( not pending_.load( memory_order_relaxed ) and not pending_.exchange( true ) ) {
+    unique_lock<mutex> lock( mutex_ );
+    if ( not closed_ ) {
+      glfwPostEmptyEvent();
+    }
+  }
+}
+
+void EventWakeup::close( void )
+{
+  unique_lock<mutex> lock( mutex_ );
+  closed_ = true;
 }
 
 void Window::make_context_current( const bool initialize_extensions )
 {
+  if ( glfwGetCurrentContext() == window_.get() and not initialize_extensions ) {
+    return;
+  }
+
   glfwMakeContextCurrent( window_.get() );
+  GLState::invalidate();
 
   glCheck( "after MakeContextCurrent" );
 
@@ -55,6 +186,11 @@ void Window::make_context_current( const bool initialize_extensions )
   }
 }
 
+void Window::set_swap_interval( const int interval )
+{
+  glfwSwapInterval( interval );
+}
+
 bool Window::should_close( void ) const
 {
   return glfwWindowShouldClose( window_.get() );
@@ -87,6 +223,17 @@ pair<unsigned int, unsigned int> Window::size( void ) const
   return pair<unsigned int, unsigned int>( width, height );
 }
 
+double Window::refresh_rate( void ) const
+{
+  GLFWmonitor * monitor = glfwGetWindowMonitor( window_.get() );
+  if ( not monitor ) {
+    monitor = glfwGetPrimaryMonitor();
+  }
+
+  const GLFWvidmode * mode = monitor ? glfwGetVideoMode( monitor ) : nullptr;
+  return mode ? mode->refreshRate : 0;
+}
+
 void Window::Deleter::operator() ( GLFWwindow * x ) const
 {
   glfwHideWindow( x );
@@ -101,6 +248,8 @@ VertexBufferObject::VertexBufferObject()
 
 VertexBufferObject::~VertexBufferObject()
 {
+  GLState::forget( GLState::Binding::ArrayBuffer, num_ );
+  GLState::forget( GLState::Binding::UniformBuffer, num_ );
   glDeleteBuffers( 1, &num_ );
 }
 
@@ -112,40 +261,70 @@ VertexArrayObject::VertexArrayObject()
 
 VertexArrayObject::~VertexArrayObject()
 {
+  GLState::forget( GLState::Binding::VertexArray, num_ );
   glDeleteVertexArrays( 1, &num_ );
 }
 
 void VertexArrayObject::bind( void )
 {
-  glBindVertexArray( num_ );
+  if ( GLState::bind( GLState::Binding::VertexArray, num_ ) ) {
+    glBindVertexArray( num_ );
+  }
 }
 
-Texture::Texture( const unsigned int width, const unsigned int height )
+Texture::Texture( const unsigned int width, const unsigned int height, const Format format )
   : num_(),
     width_( width ),
-    height_( height )
+    height_( height ),
+    format_( format )
 {
   glGenTextures( 1, &num_ );
+
+  const GLint filter = format_ == Format::Alpha ? GL_LINEAR : GL_NEAREST;
+
+  bind();
+  glTexParameteri( GL_TEXTURE_RECTANGLE, GL_TEXTURE_MIN_FILTER, filter );
+  glTexParameteri( GL_TEXTURE_RECTANGLE, GL_TEXTURE_MAG_FILTER, filter );
+  glTexParameteri( GL_TEXTURE_RECTANGLE, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+  glTexParameteri( GL_TEXTURE_RECTANGLE, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+
+  allocate();
 }
 
 Texture::~Texture()
 {
+  GLState::forget( GLState::Binding::Texture, num_ );
   glDeleteTextures( 1, &num_ );
 }
 
 void Texture::bind( void )
 {
-  glBindTexture( GL_TEXTURE_RECTANGLE, num_ );
-
-  resize( width_, height_ );
+  if ( GLState::bind( GLState::Binding::Texture, num_ ) ) {
+    glBindTexture( GL_TEXTURE_RECTANGLE, num_ );
+  }
 }
 
 void Texture::resize( const unsigned int width, const unsigned int height )
 {
+  if ( width == width_ and height == height_ ) {
+    return;
+  }
+
   width_ = width;
   height_ = height;
-  glTexImage2D( GL_TEXTURE_RECTANGLE, 0, GL_RGBA8, width_, height_, 0,
-		GL_BGRA, GL_UNSIGNED_BYTE, nullptr );
+  allocate();
+}
+
+void Texture::allocate( void )
+{
+  bind();
+  if ( format_ == Format::Alpha ) {
+    glTexImage2D( GL_TEXTURE_RECTANGLE, 0, GL_R8, width_, height_, 0,
+		  GL_RED, GL_UNSIGNED_BYTE, nullptr );
+  } else {
+    glTexImage2D( GL_TEXTURE_RECTANGLE, 0, GL_RGBA8, width_, height_, 0,
+		  GL_BGRA, GL_UNSIGNED_BYTE, nullptr );
+  }
 }
 
 void Texture::load( const Image & image )
@@ -154,9 +333,383 @@ void Texture::load( const Image & image )
     throw runtime_error( "image size does not match texture dimensions" );
   }
 
+  load( image, 0, 0, width_, height_ );
+}
+
+void Texture::load( const Image & image,
+		    const unsigned int x, const unsigned int y,
+		    const unsigned int width, const unsigned int height )
+{
+  if ( x + width > min( width_, image.size().first )
+       or y + height > min( height_, image.size().second ) ) {
+    throw runtime_error( "texture region out of bounds" );
+  }
+
+  bind();
   glPixelStorei( GL_UNPACK_ROW_LENGTH, image.stride_pixels() );
-  glTexSubImage2D( GL_TEXTURE_RECTANGLE, 0, 0, 0, width_, height_,
-		   GL_BGRA, GL_UNSIGNED_BYTE, &image.pixels().front() );
+  glTexSubImage2D( GL_TEXTURE_RECTANGLE, 0, x, y, width, height,
+		   GL_BGRA, GL_UNSIGNED_BYTE, image.pixels() + y * image.stride_pixels() + x );
+  GLState::uploaded( uint64_t( width ) * height * sizeof( uint32_t ) );
+}
+
+void Texture::load( const uint8_t * texels, const unsigned int stride,
+		    const unsigned int x, const unsigned int y,
+		    const unsigned int width, const unsigned int height )
+{
+  if ( format_ != Format::Alpha ) {
+    throw runtime_error( "single-channel load into a BGRA texture" );
+  }
+
+  if ( x + width > width_ or y + height > height_ or x + width > stride ) {
+    throw runtime_error( "texture region out of bounds" );
+  }
+
+  bind();
+  glPixelStorei( GL_UNPACK_ROW_LENGTH, stride );
+  glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
+  glTexSubImage2D( GL_TEXTURE_RECTANGLE, 0, x, y, width, height,
+		   GL_RED, GL_UNSIGNED_BYTE, texels + size_t( y ) * stride + x );
+  glPixelStorei( GL_UNPACK_ALIGNMENT, 4 );
+  GLState::uploaded( uint64_t( width ) * height );
+}
+
+PixelUnpackRing::PixelUnpackRing( const unsigned int count )
+  : slots_( count ),
+    next_( 0 ),
+    mapped_( false ),
+    orphaned_( 0 )
+{
+  if ( count == 0 ) {
+    throw runtime_error( "PixelUnpackRing needs at least one buffer" );
+  }
+
+  for ( auto & slot : slots_ ) {
+    glGenBuffers( 1, &slot.num );
+  }
+}
+
+PixelUnpackRing::~PixelUnpackRing()
+{
+  for ( auto & slot : slots_ ) {
+    if ( slot.fence ) {
+      glDeleteSync( slot.fence );
+    }
+    glDeleteBuffers( 1, &slot.num );
+  }
+}
+
+unsigned char * PixelUnpackRing::map( const size_t size_bytes )
+{
+  if ( mapped_ ) {
+    throw runtime_error( "PixelUnpackRing already mapped" );
+  }
+
+  Slot & slot = slots_.at( next_ );
+  glBindBuffer( GL_PIXEL_UNPACK_BUFFER, slot.num );
+
+  /* has the GPU finished reading this buffer? */
+  bool idle = true;
+  if ( slot.fence ) {
+    const GLenum status = glClientWaitSync( slot.fence, 0, 0 );
+    idle = (status == GL_ALREADY_SIGNALED) or (status == GL_CONDITION_SATISFIED);
+    glDeleteSync( slot.fence );
+    slot.fence = nullptr;
+  }
+
+  GLbitfield access = GL_MAP_WRITE_BIT;
+
+  if ( slot.capacity < size_bytes ) {
+    glBufferData( GL_PIXEL_UNPACK_BUFFER, size_bytes, nullptr, GL_STREAM_DRAW );
+    slot.capacity = size_bytes;
+  } else if ( idle ) {
+    /* nothing can be reading it, so skip the driver's synchronization */
+    access |= GL_MAP_UNSYNCHRONIZED_BIT;
+  } else {
+    /* still in flight: let the driver hand us fresh storage */
+    access |= GL_MAP_INVALIDATE_BUFFER_BIT;
+    orphaned_++;
+  }
+
+  void * ret = glMapBufferRange( GL_PIXEL_UNPACK_BUFFER, 0, size_bytes, access );
+  if ( not ret ) {
+    glBindBuffer( GL_PIXEL_UNPACK_BUFFER, 0 );
+    throw runtime_error( "could not map pixel-unpack buffer" );
+  }
+
+  mapped_ = true;
+  return static_cast<unsigned char *>( ret );
+}
+
+void PixelUnpackRing::upload( Texture & texture, const unsigned int stride_pixels,
+			      const vector<Region> & regions )
+{
+  if ( not mapped_ ) {
+    throw runtime_error( "PixelUnpackRing::upload without map" );
+  }
+
+  Slot & slot = slots_.at( next_ );
+  mapped_ = false;
+
+  if ( not glUnmapBuffer( GL_PIXEL_UNPACK_BUFFER ) ) {
+    glBindBuffer( GL_PIXEL_UNPACK_BUFFER, 0 );
+    throw runtime_error( "pixel-unpack buffer contents corrupted while mapped" );
+  }
+
+  /* with a pixel-unpack buffer bound, the "pointer" is an offset into it */
+  texture.bind();
+  glPixelStorei( GL_UNPACK_ROW_LENGTH, stride_pixels );
+  for ( const auto & region : regions ) {
+    if ( region.x + region.width > texture.size().first
+	 or region.y + region.height > texture.size().second ) {
+      throw runtime_error( "texture region out of bounds" );
+    }
+
+    const size_t offset = (size_t( region.y ) * stride_pixels + region.x) * sizeof( uint32_t );
+    glTexSubImage2D( GL_TEXTURE_RECTANGLE, 0, region.x, region.y, region.width, region.height,
+		     GL_BGRA, GL_UNSIGNED_BYTE, reinterpret_cast<const GLvoid *>( offset ) );
+    GLState::uploaded( uint64_t( region.width ) * region.height * sizeof( uint32_t ) );
+  }
+
+  slot.fence = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+  glBindBuffer( GL_PIXEL_UNPACK_BUFFER, 0 );
+
+  next_ = (next_ + 1) % slots_.size();
+}
+
+PixelPackRing::PixelPackRing( const unsigned int count )
+  : slots_( count ),
+    oldest_( 0 ),
+    pending_( 0 )
+{
+  if ( count == 0 ) {
+    throw runtime_error( "PixelPackRing needs at least one buffer" );
+  }
+
+  for ( auto & slot : slots_ ) {
+    glGenBuffers( 1, &slot.num );
+  }
+}
+
+PixelPackRing::~PixelPackRing()
+{
+  for ( auto & slot : slots_ ) {
+    if ( slot.fence ) {
+      glDeleteSync( slot.fence );
+    }
+    glDeleteBuffers( 1, &slot.num );
+  }
+}
+
+void PixelPackRing::read( const unsigned int width, const unsigned int height )
+{
+  if ( full() ) {
+    throw runtime_error( "PixelPackRing full" );
+  }
+
+  Slot & slot = slots_.at( (oldest_ + pending_) % slots_.size() );
+  const size_t size_bytes = size_t( width ) * height * sizeof( uint32_t );
+
+  glBindBuffer( GL_PIXEL_PACK_BUFFER, slot.num );
+  if ( slot.capacity < size_bytes ) {
+    glBufferData( GL_PIXEL_PACK_BUFFER, size_bytes, nullptr, GL_STREAM_READ );
+    slot.capacity = size_bytes;
+  }
+
+  /* with a pixel-pack buffer bound, the "pointer" is an offset into it */
+  glPixelStorei( GL_PACK_ROW_LENGTH, 0 );
+  glReadPixels( 0, 0, width, height, GL_BGRA, GL_UNSIGNED_BYTE, nullptr );
+  slot.fence = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+  slot.size = make_pair( width, height );
+
+  glBindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+  pending_++;
+}
+
+bool PixelPackRing::collect( const bool wait,
+			     const function<void( const uint8_t * pixels,
+						  const pair<unsigned int, unsigned int> & size )> & use )
+{
+  if ( empty() ) {
+    return false;
+  }
+
+  Slot & slot = slots_.at( oldest_ );
+
+  /* has the copy finished? (waiting also flushes, so it will) */
+  while ( true ) {
+    const GLenum status = glClientWaitSync( slot.fence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0,
+					    wait ? 1000000000 : 0 );
+    if ( status == GL_ALREADY_SIGNALED or status == GL_CONDITION_SATISFIED ) {
+      break;
+    } else if ( status == GL_WAIT_FAILED ) {
+      throw runtime_error( "glClientWaitSync failed" );
+    } else if ( not wait ) {
+      return false;
+    }
+  }
+
+  glDeleteSync( slot.fence );
+  slot.fence = nullptr;
+  oldest_ = (oldest_ + 1) % slots_.size();
+  pending_--;
+
+  const size_t size_bytes = size_t( slot.size.first ) * slot.size.second * sizeof( uint32_t );
+
+  glBindBuffer( GL_PIXEL_PACK_BUFFER, slot.num );
+  const void * pixels = glMapBufferRange( GL_PIXEL_PACK_BUFFER, 0, size_bytes, GL_MAP_READ_BIT );
+  if ( not pixels ) {
+    glBindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+    throw runtime_error( "could not map pixel-pack buffer" );
+  }
+
+  try {
+    use( static_cast<const uint8_t *>( pixels ), slot.size );
+  } catch ( ... ) {
+    glUnmapBuffer( GL_PIXEL_PACK_BUFFER );
+    glBindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+    throw;
+  }
+
+  glUnmapBuffer( GL_PIXEL_PACK_BUFFER );
+  glBindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+  return true;
+}
+
+/* give up on timing new frames while this many wait for their results */
+static const size_t max_pending_frames = 8;
+
+GpuTimer::GpuTimer()
+  : spare_(),
+    pending_(),
+    current_(),
+    running_( false ),
+    dropped_( 0 )
+{}
+
+GpuTimer::~GpuTimer()
+{
+  for ( const auto & frame : pending_ ) {
+    for ( const auto & query : frame.queries ) {
+      glDeleteQueries( 1, &query.num );
+    }
+  }
+
+  for ( const auto & query : current_ ) {
+    glDeleteQueries( 1, &query.num );
+  }
+
+  if ( not spare_.empty() ) {
+    glDeleteQueries( spare_.size(), spare_.data() );
+  }
+}
+
+void GpuTimer::begin( const size_t pass )
+{
+  if ( running_ ) {
+    throw runtime_error( "GpuTimer: passes overlap" );
+  }
+
+  if ( pending_.size() >= max_pending_frames ) {
+    return;
+  }
+
+  GLuint num;
+  if ( spare_.empty() ) {
+    glGenQueries( 1, &num );
+  } else {
+    num = spare_.back();
+    spare_.pop_back();
+  }
+
+  glBeginQuery( GL_TIME_ELAPSED, num );
+  current_.push_back( Query( { pass, num } ) );
+  running_ = true;
+}
+
+void GpuTimer::end( void )
+{
+  if ( running_ ) {
+    glEndQuery( GL_TIME_ELAPSED );
+    running_ = false;
+  }
+}
+
+void GpuTimer::end_frame( const uint64_t index, vector<Result> & results )
+{
+  if ( running_ ) {
+    throw runtime_error( "GpuTimer: frame ended inside a pass" );
+  }
+
+  if ( pending_.size() >= max_pending_frames ) {
+    dropped_++;
+  } else if ( not current_.empty() ) {
+    pending_.push_back( Frame( { index, move( current_ ) } ) );
+    current_.clear();
+  }
+
+  /* queries finish in order, so a frame is done when its last one is */
+  while ( not pending_.empty() ) {
+    Frame & frame = pending_.front();
+
+    GLuint available = GL_FALSE;
+    glGetQueryObjectuiv( frame.queries.back().num, GL_QUERY_RESULT_AVAILABLE, &available );
+    if ( not available ) {
+      break;
+    }
+
+    for ( const auto & query : frame.queries ) {
+      GLuint64 nanoseconds = 0;
+      glGetQueryObjectui64v( query.num, GL_QUERY_RESULT, &nanoseconds );
+      results.push_back( Result( { frame.index, query.pass, nanoseconds * 1e-9 } ) );
+      spare_.push_back( query.num );
+    }
+
+    pending_.pop_front();
+  }
+}
+
+Renderbuffer::Renderbuffer()
+  : num_()
+{
+  glGenRenderbuffers( 1, &num_ );
+}
+
+Renderbuffer::~Renderbuffer()
+{
+  glDeleteRenderbuffers( 1, &num_ );
+}
+
+void Renderbuffer::storage( const GLenum internal_format, const unsigned int width, const unsigned int height,
+			    const unsigned int samples )
+{
+  glBindRenderbuffer( GL_RENDERBUFFER, num_ );
+  glRenderbufferStorageMultisample( GL_RENDERBUFFER, samples, internal_format, width, height );
+}
+
+Framebuffer::Framebuffer()
+  : num_()
+{
+  glGenFramebuffers( 1, &num_ );
+}
+
+Framebuffer::~Framebuffer()
+{
+  glDeleteFramebuffers( 1, &num_ );
+}
+
+void Framebuffer::bind( const GLenum target )
+{
+  glBindFramebuffer( target, num_ );
+}
+
+void Framebuffer::attach_color( Renderbuffer & renderbuffer )
+{
+  bind();
+  glFramebufferRenderbuffer( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffer.num_ );
+
+  if ( glCheckFramebufferStatus( GL_FRAMEBUFFER ) != GL_FRAMEBUFFER_COMPLETE ) {
+    throw runtime_error( "incomplete framebuffer" );
+  }
 }
 
 void compile_shader( const GLuint num, const string & source )
@@ -190,36 +743,100 @@ void compile_shader( const GLuint num, const string & source )
   }
 }
 
+/* record the location of every active attribute or uniform of a program */
+static void find_locations( const GLuint num, const GLenum count_name, const GLenum max_length_name,
+			    const bool uniforms, unordered_map<string, GLint> & locations )
+{
+  GLint count, max_length;
+  glGetProgramiv( num, count_name, &count );
+  glGetProgramiv( num, max_length_name, &max_length );
+
+  vector<GLchar> buffer( max( max_length, 1 ) );
+  locations.clear();
+
+  for ( GLint i = 0; i < count; i++ ) {
+    GLsizei length;
+    GLint size;
+    GLenum type;
+
+    if ( uniforms ) {
+      glGetActiveUniform( num, i, buffer.size(), &length, &size, &type, buffer.data() );
+    } else {
+      glGetActiveAttrib( num, i, buffer.size(), &length, &size, &type, buffer.data() );
+    }
+
+    const string name( buffer.data(), length );
+    const GLint location = uniforms ? glGetUniformLocation( num, name.c_str() )
+      : glGetAttribLocation( num, name.c_str() );
+
+    /* members of uniform blocks have no location */
+    if ( location < 0 ) {
+      continue;
+    }
+
+    locations[ name ] = location;
+
+    /* arrays are listed as "name[0]", but can be found as "name" too */
+    const size_t subscript = name.rfind( "[0]" );
+    if ( subscript != string::npos and subscript + 3 == name.size() ) {
+      locations[ name.substr( 0, subscript ) ] = location;
+    }
+  }
+}
+
 void Program::link( void )
 {
   glLinkProgram( num_ );
+
+  GLint success;
+  glGetProgramiv( num_, GL_LINK_STATUS, &success );
+  if ( not success ) {
+    throw runtime_error( "GL shader program failed to link" );
+  }
+
+  find_locations( num_, GL_ACTIVE_ATTRIBUTES, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, false, attribute_locations_ );
+  find_locations( num_, GL_ACTIVE_UNIFORMS, GL_ACTIVE_UNIFORM_MAX_LENGTH, true, uniform_locations_ );
 }
 
 void Program::use( void )
 {
-  glUseProgram( num_ );
+  if ( GLState::bind( GLState::Binding::Program, num_ ) ) {
+    glUseProgram( num_ );
+  }
 }
 
 GLint Program::attribute_location( const string & name ) const
 {
-  const GLint ret = glGetAttribLocation( num_, name.c_str() );
-  if ( ret < 0 ) {
+  const auto location = attribute_locations_.find( name );
+  if ( location == attribute_locations_.end() ) {
     throw runtime_error( "attribute not found: " + name );
   }
-  return ret;
+  GLState::elided();
+  return location->second;
 }
 
 GLint Program::uniform_location( const string & name ) const
 {
-  const GLint ret = glGetUniformLocation( num_, name.c_str() );
-  if ( ret < 0 ) {
+  const auto location = uniform_locations_.find( name );
+  if ( location == uniform_locations_.end() ) {
     throw runtime_error( "uniform not found: " + name );
   }
-  return ret;
+  GLState::elided();
+  return location->second;
+}
+
+void Program::uniform_block_binding( const string & name, const GLuint binding )
+{
+  const GLuint index = glGetUniformBlockIndex( num_, name.c_str() );
+  if ( index == GL_INVALID_INDEX ) {
+    throw runtime_error( "uniform block not found: " + name );
+  }
+  glUniformBlockBinding( num_, index, binding );
 }
 
 Program::~Program()
 {
+  GLState::forget( GLState::Binding::Program, num_ );
   glDeleteProgram( num_ );
 }
 
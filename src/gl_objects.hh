@@ -9,11 +9,62 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <stdexcept>
+#include <unordered_map>
+#include <cstdint>
+#include <atomic>
+#include <mutex>
+#include <deque>
+#include <functional>
 
 class Image;
 
+/* what is bound in the current context, so binding what is already
+   bound can be skipped. glfun has one context current at a time;
+   anything that makes another one current must call invalidate().
+   also counts, per frame, the work handed to GL. */
+class GLState
+{
+public:
+  enum class Binding { Program, VertexArray, ArrayBuffer, UniformBuffer, Texture, count };
+
+  struct Counters
+  {
+    uint64_t calls;  /* binds and lookups that went to GL */
+    uint64_t elided; /* ones skipped because the answer was already known */
+    uint64_t uploaded;  /* bytes written to buffers and textures */
+    uint64_t vertices;  /* vertices submitted to draw calls */
+  };
+
+  GLState() = delete;
+
+  /* about to bind num: returns false (and counts it) if it already is */
+  static bool bind( const Binding binding, const GLuint num );
+
+  /* num is being deleted, which unbinds it */
+  static void forget( const Binding binding, const GLuint num );
+
+  /* nothing is known about the current context */
+  static void invalidate( void );
+
+  /* count a query answered without asking GL */
+  static void elided( void );
+
+  static void uploaded( const uint64_t bytes );
+  static void submitted( const uint64_t vertices );
+
+  /* counts for the frame in progress, and the last one finished */
+  static Counters frame( void );
+  static Counters last_frame( void );
+  static void end_frame( void );
+};
+
+/* GLFW is initialized by the first of these and terminated (destroying
+   every window) by the last, so any number may exist (on the main thread) */
 class GLFWContext
 {
+  static unsigned int count_;
+
   static void error_callback( const int, const char * const description );
 
 public:
@@ -31,14 +82,69 @@ class Window
 
   std::unique_ptr<GLFWwindow, Deleter> window_;
 
+  bool iconified_;
+  bool damaged_;
+
+  static void iconify_callback( GLFWwindow * window, const int iconified );
+  static void refresh_callback( GLFWwindow * window );
+
 public:
-  Window( const unsigned int width, const unsigned int height, const std::string & title );
+  /* a window whose context shares objects (buffers, textures, programs...) with share's,
+     and whose framebuffer has this many samples per pixel (0 for none) */
+  Window( const unsigned int width, const unsigned int height, const std::string & title,
+	  const bool visible = true, const Window * const share = nullptr, const unsigned int samples = 4 );
+
+  /* does nothing if it already is (unless initializing) */
   void make_context_current( const bool initialize_extensions = false );
+
+  /* frames to wait for in swap_buffers() (0 or 1); takes effect on the current context */
+  static void set_swap_interval( const int interval );
+
   bool should_close( void ) const;
   void swap_buffers( void );
   void hide_cursor( const bool hidden );
   bool key_pressed( const int key ) const;
   std::pair<unsigned int, unsigned int> size( void ) const;
+
+  /* of the monitor the window is shown on (taken to be the primary one), or 0 if unknown */
+  double refresh_rate( void ) const;
+
+  bool iconified( void ) const { return iconified_; }
+
+  /* has the window system asked for a repaint (e.g. the window was uncovered) since the last call? */
+  bool take_damage( void );
+
+  /* process events, first waiting up to timeout seconds for one to arrive */
+  static void wait_events( const double timeout );
+
+  /* forbid copy */
+  Window( const Window & other ) = delete;
+  Window & operator=( const Window & other ) = delete;
+};
+
+/* lets any thread interrupt Window::wait_events(). posts coalesce: only
+   the first since the waiter last cleared it sends an event. */
+class EventWakeup
+{
+  std::atomic<bool> pending_;
+
+  std::mutex mutex_;
+  bool closed_;
+
+public:
+  EventWakeup() : pending_( false ), mutex_(), closed_( false ) {}
+
+  void post( void );
+
+  /* call before checking for whatever the posts announce, so none are missed */
+  void clear( void ) { pending_.store( false ); }
+
+  /* once this returns, posts do nothing (for posters that may outlive the waiter) */
+  void close( void );
+
+  /* forbid copy */
+  EventWakeup( const EventWakeup & other ) = delete;
+  EventWakeup & operator=( const EventWakeup & other ) = delete;
 };
 
 template <GLenum id_>
@@ -47,25 +153,74 @@ class Buffer
 public:
   Buffer() = delete;
 
+  static_assert( id_ == GL_ARRAY_BUFFER or id_ == GL_UNIFORM_BUFFER, "binding not tracked by GLState" );
+  constexpr static GLState::Binding binding = id_ == GL_ARRAY_BUFFER ? GLState::Binding::ArrayBuffer
+    : GLState::Binding::UniformBuffer;
+
   template <class T>
   static void bind( const T & obj )
   {
-    glBindBuffer( id_, obj.num_ );
+    if ( GLState::bind( binding, obj.num_ ) ) {
+      glBindBuffer( id_, obj.num_ );
+    }
   }
 
   static void load( const std::vector<std::pair<float, float>> & vertices, const GLenum usage )
   {
     glBufferData( id, vertices.size() * sizeof( std::pair<float, float> ), &vertices.front(), usage );
+    GLState::uploaded( vertices.size() * sizeof( std::pair<float, float> ) );
+  }
+
+  static void allocate( const size_t size_bytes, const GLenum usage )
+  {
+    glBufferData( id, size_bytes, nullptr, usage );
+  }
+
+  static void load_range( const size_t offset_bytes, const size_t size_bytes, const void * data )
+  {
+    glBufferSubData( id, offset_bytes, size_bytes, data );
+    GLState::uploaded( size_bytes );
+  }
+
+  static void * map_range( const size_t offset_bytes, const size_t size_bytes, const GLbitfield access )
+  {
+    void * ret = glMapBufferRange( id, offset_bytes, size_bytes, access );
+    if ( not ret ) {
+      throw std::runtime_error( "glMapBufferRange failed" );
+    }
+
+    /* counted as if all of it is written */
+    if ( access & GL_MAP_WRITE_BIT ) {
+      GLState::uploaded( size_bytes );
+    }
+    return ret;
+  }
+
+  static void unmap( void )
+  {
+    if ( not glUnmapBuffer( id ) ) {
+      throw std::runtime_error( "buffer contents corrupted while mapped" );
+    }
+  }
+
+  /* for indexed targets (e.g. uniform buffers) */
+  template <class T>
+  static void bind_base( const T & obj, const GLuint index )
+  {
+    /* this binds the general binding point too */
+    GLState::bind( binding, obj.num_ );
+    glBindBufferBase( id_, index, obj.num_ );
   }
 
   constexpr static GLenum id = id_;
 };
 
 using ArrayBuffer = Buffer<GL_ARRAY_BUFFER>;
+using UniformBuffer = Buffer<GL_UNIFORM_BUFFER>;
 
 class VertexBufferObject
 {
-  friend ArrayBuffer;
+  template <GLenum id_> friend class Buffer;
 
   GLuint num_;
 
@@ -95,16 +250,34 @@ public:
 
 class Texture
 {
+public:
+  /* BGRA pixels sampled exactly, or a single channel sampled with linear filtering */
+  enum class Format { BGRA, Alpha };
+
+private:
   GLuint num_;
 
   unsigned int width_, height_;
+  Format format_;
+
+  void allocate( void );
 
 public:
-  Texture( const unsigned int width, const unsigned int height);
+  Texture( const unsigned int width, const unsigned int height, const Format format = Format::BGRA );
   ~Texture();
 
   void bind( void );
   void load( const Image & image );
+  void load( const Image & image,
+	     const unsigned int x, const unsigned int y,
+	     const unsigned int width, const unsigned int height );
+
+  /* a region of a single-channel texture, from rows of stride bytes */
+  void load( const uint8_t * texels, const unsigned int stride,
+	     const unsigned int x, const unsigned int y,
+	     const unsigned int width, const unsigned int height );
+
+  /* reallocates the storage only if the size changes */
   void resize( const unsigned int width, const unsigned int height );
   std::pair<unsigned int, unsigned int> size( void ) const { return std::make_pair( width_, height_ ); }
 
@@ -113,6 +286,199 @@ public:
   Texture & operator=( const Texture & other ) = delete;
 };
 
+/* a small ring of pixel-unpack buffers: draw into a mapped buffer,
+   then upload to a texture without the CPU waiting on the transfer.
+   a buffer whose last upload may still be in flight is orphaned
+   instead of waited on. */
+class PixelUnpackRing
+{
+  struct Slot
+  {
+    GLuint num = 0;
+    GLsync fence = nullptr;
+    size_t capacity = 0;
+  };
+
+  std::vector<Slot> slots_;
+  size_t next_;
+  bool mapped_;
+
+  uint64_t orphaned_;
+
+public:
+  PixelUnpackRing( const unsigned int count = 3 );
+  ~PixelUnpackRing();
+
+  struct Region
+  {
+    unsigned int x, y, width, height;
+  };
+
+  /* map the next buffer for writing */
+  unsigned char * map( const size_t size_bytes );
+
+  /* unmap, upload regions (laid out with the given stride) to the texture, and fence */
+  void upload( Texture & texture, const unsigned int stride_pixels, const std::vector<Region> & regions );
+
+  /* how many times a busy buffer was orphaned rather than waited on */
+  uint64_t orphaned( void ) const { return orphaned_; }
+
+  /* forbid copy */
+  PixelUnpackRing( const PixelUnpackRing & other ) = delete;
+  PixelUnpackRing & operator=( const PixelUnpackRing & other ) = delete;
+};
+
+/* a small ring of pixel-pack buffers: start reading a framebuffer back
+   into the next buffer, and collect it a few frames later, once the
+   transfer has finished, so reading back never stalls the GPU (or the
+   CPU, unless every buffer is still in flight). */
+class PixelPackRing
+{
+  struct Slot
+  {
+    GLuint num = 0;
+    GLsync fence = nullptr;
+    size_t capacity = 0;
+    std::pair<unsigned int, unsigned int> size = { 0, 0 };
+  };
+
+  std::vector<Slot> slots_;
+  size_t oldest_;
+  size_t pending_;
+
+public:
+  PixelPackRing( const unsigned int count = 3 );
+  ~PixelPackRing();
+
+  /* start copying the bound read framebuffer's lower-left width x height
+     (BGRA, bottom row first, unpadded) into the next buffer; not when full */
+  void read( const unsigned int width, const unsigned int height );
+
+  /* pass the oldest copy to use, if it has arrived (or, if wait, once it
+     has); returns whether there was one */
+  bool collect( const bool wait,
+		const std::function<void( const uint8_t * pixels,
+					  const std::pair<unsigned int, unsigned int> & size )> & use );
+
+  bool full( void ) const { return pending_ == slots_.size(); }
+  bool empty( void ) const { return pending_ == 0; }
+
+  /* forbid copy */
+  PixelPackRing( const PixelPackRing & other ) = delete;
+  PixelPackRing & operator=( const PixelPackRing & other ) = delete;
+};
+
+/* GL_TIME_ELAPSED queries around the passes of each frame. a frame's
+   results are collected only once the GPU has finished it (a few frames
+   later), so timing never makes the CPU wait. passes may not overlap. */
+class GpuTimer
+{
+public:
+  struct Result
+  {
+    uint64_t frame;
+    size_t pass;
+    double seconds;
+  };
+
+private:
+  struct Query
+  {
+    size_t pass;
+    GLuint num;
+  };
+
+  struct Frame
+  {
+    uint64_t index;
+    std::vector<Query> queries;
+  };
+
+  std::vector<GLuint> spare_;
+  std::deque<Frame> pending_;
+  std::vector<Query> current_;
+  bool running_;
+  uint64_t dropped_;
+
+public:
+  GpuTimer();
+  ~GpuTimer();
+
+  void begin( const size_t pass );
+  void end( void );
+
+  /* finish the frame in progress, numbered index, and append the
+     results of every frame the GPU is done with to results */
+  void end_frame( const uint64_t index, std::vector<Result> & results );
+
+  /* frames left untimed because too many were still waiting on the GPU */
+  uint64_t dropped( void ) const { return dropped_; }
+
+  /* times one pass, if there is a timer */
+  class Scope
+  {
+    GpuTimer * timer_;
+
+  public:
+    Scope( GpuTimer * const timer, const size_t pass )
+      : timer_( timer )
+    {
+      if ( timer_ ) {
+	timer_->begin( pass );
+      }
+    }
+
+    ~Scope()
+    {
+      if ( timer_ ) {
+	timer_->end();
+      }
+    }
+
+    /* forbid copy */
+    Scope( const Scope & other ) = delete;
+    Scope & operator=( const Scope & other ) = delete;
+  };
+
+  /* forbid copy */
+  GpuTimer( const GpuTimer & other ) = delete;
+  GpuTimer & operator=( const GpuTimer & other ) = delete;
+};
+
+class Renderbuffer
+{
+  friend class Framebuffer;
+
+  GLuint num_;
+
+public:
+  Renderbuffer();
+  ~Renderbuffer();
+
+  void storage( const GLenum internal_format, const unsigned int width, const unsigned int height,
+		const unsigned int samples = 0 );
+
+  /* forbid copy */
+  Renderbuffer( const Renderbuffer & other ) = delete;
+  Renderbuffer & operator=( const Renderbuffer & other ) = delete;
+};
+
+class Framebuffer
+{
+  GLuint num_;
+
+public:
+  Framebuffer();
+  ~Framebuffer();
+
+  void bind( const GLenum target = GL_FRAMEBUFFER );
+  void attach_color( Renderbuffer & renderbuffer );
+
+  /* forbid copy */
+  Framebuffer( const Framebuffer & other ) = delete;
+  Framebuffer & operator=( const Framebuffer & other ) = delete;
+};
+
 void compile_shader( const GLuint num, const std::string & source );
 
 template <GLenum type_>
@@ -142,6 +508,10 @@ class Program
 {
   GLuint num_ = glCreateProgram();
 
+  /* active attributes and uniforms, found when linked */
+  std::unordered_map<std::string, GLint> attribute_locations_ = {};
+  std::unordered_map<std::string, GLint> uniform_locations_ = {};
+
 public:
   Program() {}
   ~Program();
@@ -155,9 +525,13 @@ public:
   void link( void );
   void use( void );
 
+  /* these don't call GL */
   GLint attribute_location( const std::string & name ) const;
   GLint uniform_location( const std::string & name ) const;
 
+  /* connect a uniform block to a uniform buffer binding point */
+  void uniform_block_binding( const std::string & name, const GLuint binding );
+
   /* forbid copy */
   Program( const Program & other ) = delete;
   Program & operator=( const Program & other ) = delete;
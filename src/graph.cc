@@ -1,8 +1,7 @@
 #include <cmath>
+#include <cstdio>
 #include <sstream>
 #include <locale>
-#include <numeric>
-#include <limits>
 #include <algorithm>
 #include <cassert>
 
@@ -12,37 +11,209 @@
 
 using namespace std;
 
-Graph::Graph( const unsigned int initial_width, const unsigned int initial_height, const string & title )
-  : display_( initial_width, initial_height, title ),
-    cairo_( display_.window().size() ),
-    pango_( cairo_ ),
+static const string x_title = "time (s)";
+static const string y_title = "packets in flight";
+
+Graph::Graph( const unsigned int initial_width, const unsigned int initial_height, const string & title,
+	      const size_t data_capacity, const bool offscreen, const Display::Antialiasing antialiasing )
+  : Graph( nullptr, initial_width, initial_height, title, data_capacity, offscreen, antialiasing )
+{}
+
+Graph::Graph( SharedContext * const shared,
+	      const unsigned int initial_width, const unsigned int initial_height, const string & title,
+	      const size_t data_capacity, const bool offscreen, const Display::Antialiasing antialiasing )
+  : display_( shared, initial_width, initial_height, title, offscreen, antialiasing ),
+    x_strip_texture_( x_strip_size( display_.size() ).first,
+		      x_strip_size( display_.size() ).second ),
+    static_layer_texture_( display_.size().first, display_.size().second ),
+    y_layer_texture_( display_.size().first, display_.size().second ),
+    pixel_unpack_ring_(),
+    text_cairo_( make_pair( 1, 1 ) ),
+    pango_( text_cairo_ ),
     tick_font_( "ACaslon Regular, Normal 30" ),
     label_font_( "ACaslon Regular, Normal 20" ),
-    x_tick_labels_(),
+    tick_labels_(),
     y_tick_labels_(),
-    data_points_(),
-    x_label_( cairo_, pango_, label_font_, "time (s)" ),
-    y_label_( cairo_, pango_, label_font_, "packets in flight" ),
+    data_capacity_( data_capacity ),
+    series_(),
+    series_to_draw_(),
+    envelope_columns_(),
+    x_label_( text_cairo_, pango_, label_font_, x_title ),
+    y_label_( text_cairo_, pango_, label_font_, y_title ),
     bottom_adjustment_( 1.0 ),
     top_adjustment_( 1.0 ),
     bottom_( 0 ),
     top_( 1 ),
-    horizontal_fadeout_( cairo_pattern_create_linear( 0, 0, 190, 0 ) )
+    horizontal_fadeout_( cairo_pattern_create_linear( 0, 0, 190, 0 ) ),
+    x_strip_pixels_per_second_( 0 ),
+    x_strip_valid_from_( 0 ),
+    x_strip_valid_until_( 0 ),
+    static_layer_valid_( false ),
+    y_layer_drawn_(),
+    overlay_pool_( new WorkerPool( 1 ) ),
+    profiler_( nullptr ),
+    producers_mutex_(),
+    producers_(),
+    ingest_batch_(),
+    last_ingest_size_( 0 ),
+    wakeup_( make_shared<EventWakeup>() ),
+    idle_( false ),
+    data_version_( 0 ),
+    shown_( { 0, 0, { 0, 0 }, 0, { 0, 0, 0, 0 }, false } ),
+    frame_drawn_( false ),
+    sdf_text_( false ),
+    text_atlas_(),
+    label_formatter_(),
+    text_quads_(),
+    hud_( false ),
+    hud_font_( "Monospace 11" ),
+    hud_lines_(),
+    hud_updated_frame_( 0 )
 {
   cairo_pattern_add_color_stop_rgba( horizontal_fadeout_, 0.0, 1, 1, 1, 1 );
   cairo_pattern_add_color_stop_rgba( horizontal_fadeout_, 0.67, 1, 1, 1, 1 );
   cairo_pattern_add_color_stop_rgba( horizontal_fadeout_, 1.0, 1, 1, 1, 0 );
+
+  add_series( 1.0, 0.38, 0.0, 0.75 );
+}
+
+Graph::~Graph()
+{
+  /* producers may still be pushing (and posting) after the graph is gone */
+  wakeup_->close();
 }
 
 void Graph::set_window( const float t, const float logical_width )
 {
-  while ( (not data_points_.empty()) and (data_points_.front().first < t - logical_width - 1) ) {
-    data_points_.pop_front();
+  for ( auto & x : series_ ) {
+    while ( (not x.points.empty()) and (x.points.front_time() < t - logical_width - 1) ) {
+      x.points.pop_front();
+    }
+
+    x.extremes.expire( x.points.pushed() - x.points.size() );
+  }
+}
+
+size_t Graph::add_series( const float red, const float green, const float blue, const float alpha,
+			  const float width )
+{
+  if ( series_.size() == Display::max_batch_series ) {
+    throw runtime_error( "too many series" );
+  }
+
+  series_.push_back( Series( { SampleRing( data_capacity_ ), SlidingExtremes(),
+			       HistoryPyramid(), SampleRing( 1 ),
+			       red, green, blue, alpha, width } ) );
+  return series_.size() - 1;
+}
+
+size_t Graph::add_series( const float width )
+{
+  /* step around the color wheel by the golden angle, so any number of series stay distinct */
+  const double hue = 2 * M_PI * 0.381966 * series_.size();
+  return add_series( 0.5 + 0.45 * cos( hue ), 0.5 + 0.45 * cos( hue - 2 * M_PI / 3 ),
+		     0.5 + 0.45 * cos( hue + 2 * M_PI / 3 ), 0.75, width );
+}
+
+void Graph::add_data_point( const size_t series, const float t, const float y )
+{
+  Series & x = series_.at( series );
+  x.points.push_back( t, y );
+  x.history.add( t, y );
+  data_version_++;
+
+  /* the ring may have overwritten its oldest sample */
+  x.extremes.push( x.points.pushed() - 1, y );
+  x.extremes.expire( x.points.pushed() - x.points.size() );
+}
+
+void Graph::add_data_points( const size_t series, const float * times, const float * values, const size_t count )
+{
+  Series & x = series_.at( series );
+  const uint64_t first_sequence_number = x.points.pushed();
+
+  x.points.push_back( times, values, count );
+  for ( size_t i = 0; i < count; i++ ) {
+    x.history.add( times[ i ], values[ i ] );
   }
+  data_version_++;
 
-  while ( (not x_tick_labels_.empty()) and (x_tick_labels_.front().first < t - logical_width - 1) ) {
-    x_tick_labels_.pop_front();
+  /* only what the ring kept can matter to the extremes */
+  for ( size_t i = count - min( count, x.points.capacity() ); i < count; i++ ) {
+    x.extremes.push( first_sequence_number + i, values[ i ] );
   }
+  x.extremes.expire( x.points.pushed() - x.points.size() );
+}
+
+shared_ptr<SampleQueue> Graph::add_producer( const size_t capacity, const size_t series )
+{
+  if ( series >= series_.size() ) {
+    throw runtime_error( "add_producer: no such series" );
+  }
+
+  auto queue = make_shared<SampleQueue>( capacity );
+  const shared_ptr<EventWakeup> wakeup = wakeup_;
+  queue->set_notify( [wakeup] () { wakeup->post(); } );
+
+  unique_lock<mutex> lock( producers_mutex_ );
+  producers_.push_back( Producer( { series, queue } ) );
+  return queue;
+}
+
+void Graph::ingest( void )
+{
+  last_ingest_size_ = 0;
+
+  unique_lock<mutex> lock( producers_mutex_ );
+
+  for ( size_t series = 0; series < series_.size(); series++ ) {
+    ingest_batch_.clear();
+    size_t nonempty_queues = 0;
+
+    for ( const auto & producer : producers_ ) {
+      if ( producer.series == series and producer.queue->drain( ingest_batch_ ) ) {
+	nonempty_queues++;
+      }
+    }
+
+    /* each queue is in order, but producers interleave */
+    if ( nonempty_queues > 1 ) {
+      stable_sort( ingest_batch_.begin(), ingest_batch_.end(),
+		   [] ( const SampleQueue::Sample & a, const SampleQueue::Sample & b ) { return a.t < b.t; } );
+    }
+
+    for ( const auto & sample : ingest_batch_ ) {
+      add_data_point( series, sample.t, sample.y );
+    }
+
+    last_ingest_size_ += ingest_batch_.size();
+  }
+}
+
+Graph::IngestStats Graph::ingest_stats( void ) const
+{
+  unique_lock<mutex> lock( producers_mutex_ );
+
+  IngestStats stats = { producers_.size(), 0, 0, 0, 0, last_ingest_size_ };
+  for ( const auto & producer : producers_ ) {
+    stats.occupancy += producer.queue->occupancy();
+    stats.peak_occupancy = max( stats.peak_occupancy, producer.queue->peak_occupancy() );
+    stats.capacity += producer.queue->capacity();
+    stats.dropped += producer.queue->dropped();
+  }
+
+  return stats;
+}
+
+AffineTransform Graph::data_to_window( const float t, const float logical_width,
+				       const pair<unsigned int, unsigned int> & window_size ) const
+{
+  /* x = width - (t - time) * width / logical_width, y = chart_height( value ) */
+  const double x_scale = window_size.first / double( logical_width );
+  const double y_scale = -0.825 * window_size.second / (top_ - bottom_);
+
+  return AffineTransform( { x_scale, window_size.first - t * x_scale,
+			    y_scale, window_size.second * (.825 + .025) - bottom_ * y_scale } );
 }
 
 static int to_int( const float x )
@@ -50,67 +221,140 @@ static int to_int( const float x )
   return static_cast<int>( lrintf( x ) );
 }
 
-bool Graph::blocking_draw( const float t, const float logical_width )
+/* a little wider than the window, so the strip never has to show a column it is drawing over */
+pair<unsigned int, unsigned int> Graph::x_strip_size( const pair<unsigned int, unsigned int> & window_size )
 {
-  /* get the current window size */
-  const auto window_size = display_.window().size();
+  return make_pair( window_size.first + 8, window_size.second );
+}
 
-  /* do we need to resize? */
-  if ( window_size != cairo_.image().size() ) {
-    display_.resize( window_size );
-    cairo_ = Cairo( window_size );
-  }
+void Graph::resize( const pair<unsigned int, unsigned int> & window_size )
+{
+  display_.resize( window_size );
 
-  /* start a new image */
-  cairo_.mutable_image().clear();
+  x_strip_texture_.resize( x_strip_size( window_size ).first, x_strip_size( window_size ).second );
+  static_layer_texture_.resize( window_size.first, window_size.second );
+  y_layer_texture_.resize( window_size.first, window_size.second );
+
+  /* everything must be redrawn */
+  x_strip_pixels_per_second_ = 0;
+  static_layer_valid_ = false;
+  y_layer_drawn_.clear();
+  shown_.valid = false;
+}
 
-  /* do we need to make a new label? */
-  while ( x_tick_labels_.empty() or (x_tick_labels_.back().first < t + 1) ) { /* start when offscreen */
-    const int next_label = x_tick_labels_.empty() ? to_int( t ) : x_tick_labels_.back().first + 1;
+/* columns of a window drawn from the history should each hold at least this many raw samples */
+static const size_t history_samples_per_column = 8;
+
+bool Graph::history_needed( const float t, const float logical_width, const unsigned int columns ) const
+{
+  const double column_width = logical_width / double( columns );
+  const double start = t - logical_width;
+
+  for ( const auto & x : series_ ) {
+    /* finer than the finest buckets, the raw samples are all there is */
+    if ( x.history.empty() or column_width < 2 * x.history.base_width() ) {
+      continue;
+    }
 
-    /* add commas as appropriate */
-    stringstream ss;
-    ss.imbue( locale( "" ) );
-    ss << fixed << next_label;
+    /* the points don't reach back to the window's start, but the history does */
+    if ( (x.points.empty() or x.points.front_time() > start + column_width)
+	 and x.history.earliest() < start + column_width ) {
+      return true;
+    }
 
-    x_tick_labels_.emplace_back( next_label, Pango::Text( cairo_, pango_, tick_font_, ss.str() ) );
+    /* or there are too many of them to draw each frame */
+    if ( x.points.size() > history_samples_per_column * columns ) {
+      return true;
+    }
   }
 
-  /* draw the labels and vertical grid */
-  for ( const auto & x : x_tick_labels_ ) {
-    /* position the text in the window */
-    const double x_position = window_size.first - (t - x.first) * window_size.first / logical_width;
+  return false;
+}
 
-    x.second.draw_centered_at( cairo_,
-			       x_position,
-			       window_size.second * 9.0 / 10.0 );
+void Graph::update_envelopes( const float t, const float logical_width, const unsigned int columns )
+{
+  const double column_width = logical_width / double( columns );
+  const double start = t - logical_width;
 
-    cairo_set_source_rgba( cairo_, 0, 0, 0.4, 1 );
-    cairo_fill( cairo_ );
+  envelope_columns_.resize( columns );
 
-    /* draw vertical grid line */
-    cairo_identity_matrix( cairo_ );
-    cairo_set_line_width( cairo_, 2 );
-    cairo_move_to( cairo_, x_position, window_size.second * 0.25 / 10.0 );
-    cairo_line_to( cairo_, x_position, window_size.second * 8.5 / 10.0 );
-    cairo_set_source_rgba( cairo_, 0, 0, 0.4, 0.25 );
-    cairo_stroke( cairo_ );
+  for ( auto & x : series_ ) {
+    /* a min and max per column, and the newest sample */
+    const size_t needed = 2 * size_t( columns ) + 1;
+    if ( x.envelope.capacity() < needed ) {
+      size_t capacity = max<size_t>( x.envelope.capacity(), 1 );
+      while ( capacity < needed ) {
+	capacity *= 2;
+      }
+      x.envelope = SampleRing( capacity );
+    }
+
+    /* clearing keeps the push count going, so the display re-uploads it all */
+    x.envelope.clear();
+
+    x.history.envelopes( start, t, envelope_columns_ );
+
+    for ( size_t column = 0; column < columns; column++ ) {
+      const HistoryPyramid::Envelope & e = envelope_columns_[ column ];
+      if ( e.empty() ) {
+	continue;
+      }
+
+      /* continue from the previous column's last value with whichever extreme is nearer */
+      const float middle = start + (column + 0.5) * column_width;
+      if ( x.envelope.empty() or x.envelope.back_value() <= (e.min + e.max) / 2 ) {
+	x.envelope.push_back( middle, e.min );
+	x.envelope.push_back( middle, e.max );
+      } else {
+	x.envelope.push_back( middle, e.max );
+	x.envelope.push_back( middle, e.min );
+      }
+    }
+
+    /* so the line still ends at the latest sample */
+    if ( (not x.points.empty())
+	 and (x.envelope.empty() or x.points.back_time() > x.envelope.back_time()) ) {
+      x.envelope.push_back( x.points.back_time(), x.points.back_value() );
+    }
   }
+}
+
+void Graph::autoscale( const bool from_history )
+{
+  bool have_data = false;
+  float data_max = 0, data_min = 0;
+  for ( const auto & x : series_ ) {
+    float x_min, x_max;
+
+    if ( from_history ) {
+      if ( x.envelope.empty() ) {
+	continue;
+      }
+
+      const auto spans = x.envelope.spans();
+      x_min = x_max = x.envelope.back_value();
+      for ( const auto & span : { spans.first, spans.second } ) {
+	for ( size_t i = 0; i < span.length; i++ ) {
+	  x_min = min( x_min, span.values[ i ] );
+	  x_max = max( x_max, span.values[ i ] );
+	}
+      }
+    } else {
+      if ( x.extremes.empty() ) {
+	continue;
+      }
 
-  /* draw the x-axis label */
-  x_label_.draw_centered_at( cairo_, 35 + window_size.first / 2, window_size.second * 9.6 / 10.0 );
-  cairo_set_source_rgba( cairo_, 0, 0, 0.4, 1 );
-  cairo_fill( cairo_ );
+      x_min = x.extremes.min();
+      x_max = x.extremes.max();
+    }
 
-  /* autoscale vertically */
-  if ( not data_points_.empty() ) {
+    data_max = have_data ? max( data_max, x_max ) : x_max;
+    data_min = have_data ? min( data_min, x_min ) : x_min;
+    have_data = true;
+  }
+
+  if ( have_data ) {
     /* adjust bottom and top */
-    float data_max = accumulate( data_points_.begin(), data_points_.end(), numeric_limits<float>::min(),
-				 [] ( const float x, const pair<float, float> & y ) {
-				   return max( x, y.second ); } );
-    float data_min = accumulate( data_points_.begin(), data_points_.end(), numeric_limits<float>::max(),
-				 [] ( const float x, const pair<float, float> & y ) {
-				   return min( x, y.second ); } );
 
     /* stop adjusting if data are good enough */
     if ( project_height( data_max ) > 0.833 ) {
@@ -143,19 +387,14 @@ bool Graph::blocking_draw( const float t, const float logical_width )
     bottom_ = bottom_ * (1 - bottom_adjustment_) + (data_min - 0.15 * (data_max - data_min)) * bottom_adjustment_;
   }
 
-  /* draw the y-axis labels */
+}
 
-  /* draw a box to hide other labels */
-  cairo_new_path( cairo_ );
-  cairo_identity_matrix( cairo_ );
-  cairo_rectangle( cairo_, 0, 0, 190, window_size.second );
-  cairo_set_source( cairo_, horizontal_fadeout_ );
-  cairo_fill( cairo_ );
+/* how far a y label or grid line can reach above or below its height, in pixels */
+static const double y_label_reach = 40;
 
-  /* draw the y-axis label */
-  y_label_.draw_centered_rotated_at( cairo_, 25, window_size.second * .4375 );
-  cairo_set_source_rgba( cairo_, 0, 0, 0.4, 1 );
-  cairo_fill( cairo_ );
+void Graph::update_y_tick_labels( void )
+{
+  ScopedTimer timer( profiler_, Profiler::Overlay );
 
   int label_bottom = to_int( floor( bottom_ ) );
   int label_top = to_int( ceil( top_ ) );
@@ -168,6 +407,16 @@ bool Graph::blocking_draw( const float t, const float logical_width )
   label_bottom = (label_bottom / label_spacing) * label_spacing;
   label_top = (label_top / label_spacing) * label_spacing;
 
+  /* have the labels lay out ahead of time those we might need if the range shifts or rescales */
+  {
+    const int step = max( 1, label_spacing / 2 );
+    for ( int val = label_bottom - 2 * label_spacing; val <= label_top + 2 * label_spacing; val += step ) {
+      if ( not sdf_text_ ) {
+	tick_labels_.prefetch( label_font_, val );
+      }
+    }
+  }
+
   /* cull old labels */
   {
     auto it = y_tick_labels_.begin();
@@ -225,51 +474,553 @@ bool Graph::blocking_draw( const float t, const float logical_width )
       continue;
     }
 
-    stringstream ss;
-    ss.imbue( locale( "" ) );
-    ss << fixed << x.first;
+    y_tick_labels_.emplace_back( YLabel( { x.first, sdf_text_ ? nullptr : tick_labels_.get( label_font_, x.first ),
+					   0.05 } ) );
+  }
+}
+
+void Graph::draw_static_layer( const pair<unsigned int, unsigned int> & window_size )
+{
+  draw_layer( static_layer_texture_, { { 0, 0, window_size.first, window_size.second } },
+	      [&] ( Cairo & layer ) {
+		layer.mutable_image().clear_transparent();
 
-    y_tick_labels_.emplace_back( YLabel( { x.first, Pango::Text( cairo_, pango_, label_font_, ss.str() ), 0.05 } ) );
+		/* draw the x-axis label */
+		if ( not sdf_text_ ) {
+		  x_label_.draw_centered_at( layer, x_title_position( window_size ).first,
+					     x_title_position( window_size ).second );
+		  cairo_set_source_rgba( layer, 0, 0, 0.4, 1 );
+		  cairo_fill( layer );
+		}
+
+		/* draw a box to hide other labels */
+		cairo_new_path( layer );
+		layer.identity_matrix();
+		cairo_rectangle( layer, 0, 0, 190, window_size.second );
+		cairo_set_source( layer, horizontal_fadeout_ );
+		cairo_fill( layer );
+
+		/* draw the y-axis label */
+		if ( not sdf_text_ ) {
+		  y_label_.draw_centered_rotated_at( layer, y_title_position( window_size ).first,
+						     y_title_position( window_size ).second );
+		  cairo_set_source_rgba( layer, 0, 0, 0.4, 1 );
+		  cairo_fill( layer );
+		}
+	      } );
+
+  static_layer_valid_ = true;
+}
+
+/* widest reach of an x label or grid line from its position, in pixels */
+static const double x_strip_label_reach = 200;
+
+/* seconds between x ticks: the shortest of these that keeps them this far apart */
+static const int x_tick_intervals[] = { 1, 2, 5, 10, 15, 30, 60, 120, 300, 600, 900, 1800, 3600, 7200 };
+static const double x_tick_min_spacing = 100;
+
+static int x_tick_interval( const double pixels_per_second )
+{
+  for ( const int interval : x_tick_intervals ) {
+    if ( interval * pixels_per_second >= x_tick_min_spacing ) {
+      return interval;
+    }
   }
+  return x_tick_intervals[ sizeof( x_tick_intervals ) / sizeof( x_tick_intervals[ 0 ] ) - 1 ];
+}
+
+float Graph::draw_x_strip( const float t, const float logical_width,
+			   const pair<unsigned int, unsigned int> & window_size )
+{
+  const int64_t strip_width = x_strip_texture_.size().first;
+  const double pixels_per_second = window_size.first / double( logical_width );
+
+  /* absolute pixel position of the right edge of the window */
+  const double right_edge = t * pixels_per_second;
+
+  /* columns that will be visible this frame */
+  const int64_t visible_first = int64_t( floor( right_edge ) ) - window_size.first;
+  const int64_t visible_last = int64_t( ceil( right_edge ) ) + 1;
 
-  /* go through and paint all the labels */
+  /* the strip holds at most its width's worth of columns, ending at valid_until */
+  const int64_t valid_first = max( x_strip_valid_from_, x_strip_valid_until_ - strip_width );
+
+  if ( (pixels_per_second != x_strip_pixels_per_second_)
+       or (visible_first < valid_first)
+       or (visible_first > x_strip_valid_until_) ) {
+    /* start over */
+    x_strip_pixels_per_second_ = pixels_per_second;
+    x_strip_valid_from_ = x_strip_valid_until_ = visible_first;
+  }
+
+  /* ticks are numbered in intervals from time 0 */
+  const int interval = x_tick_interval( pixels_per_second );
+  const double pixels_per_tick = interval * pixels_per_second;
+
+  /* lay out the next few labels before they come within reach of the right edge */
+  const int next_label = to_int( ceil( (visible_last + x_strip_label_reach) / pixels_per_tick ) );
+  for ( int label = next_label; label < next_label + 3 and not sdf_text_; label++ ) {
+    tick_labels_.prefetch( tick_font_, label * interval );
+  }
+
+  /* draw only the newly exposed columns, split where they wrap around the strip */
+  if ( x_strip_valid_until_ < visible_last ) {
+    vector<XStripRun> runs;
+    vector<PixelUnpackRing::Region> regions;
+
+    for ( int64_t column = x_strip_valid_until_; column < visible_last; ) {
+      const int64_t base = int64_t( floor( column / double( strip_width ) ) ) * strip_width;
+      const int64_t end = min( visible_last, base + strip_width );
+
+      /* the labels are looked up here, since the cache may only be used on this thread
+	 (with distance-field text, the strip has only the grid) */
+      runs.push_back( XStripRun( { column, end, base, {} } ) );
+      const int first_label = to_int( ceil( (column - x_strip_label_reach) / pixels_per_tick ) );
+      const int last_label = to_int( floor( (end + x_strip_label_reach) / pixels_per_tick ) );
+      for ( int label = first_label; label <= last_label; label++ ) {
+	runs.back().labels.emplace_back( label * pixels_per_tick - base,
+					 sdf_text_ ? nullptr : tick_labels_.get( tick_font_, label * interval ) );
+      }
+
+      regions.push_back( { static_cast<unsigned int>( column - base ), 0,
+			   static_cast<unsigned int>( end - column ), window_size.second } );
+      column = end;
+    }
+
+    draw_layer( x_strip_texture_, regions,
+		[&] ( Cairo & strip ) {
+		  for ( const auto & run : runs ) {
+		    draw_x_strip_columns( strip, run, window_size.second );
+		  }
+		} );
+  }
+
+  x_strip_valid_until_ = max( x_strip_valid_until_, visible_last );
+
+  /* window column x shows strip column (x + scroll) mod strip_width */
+  const double scroll = fmod( right_edge - window_size.first, double( strip_width ) );
+  return scroll < 0 ? scroll + strip_width : scroll;
+}
+
+void Graph::draw_x_strip_columns( Cairo & strip, const XStripRun & run, const unsigned int window_height )
+{
+  cairo_save( strip );
+  strip.identity_matrix();
+  cairo_new_path( strip );
+  cairo_rectangle( strip, run.first - run.base, 0, run.last - run.first, window_height );
+  cairo_clip( strip );
+
+  cairo_set_source_rgba( strip, 1, 1, 1, 1 );
+  cairo_paint( strip );
+
+  /* draw the labels and vertical grid */
+  for ( const auto & label : run.labels ) {
+    /* position the text in the strip */
+    const double x_position = label.first;
+
+    if ( label.second ) {
+      label.second->draw_centered_at( strip, x_position, window_height * 9.0 / 10.0 );
+
+      cairo_set_source_rgba( strip, 0, 0, 0.4, 1 );
+      cairo_fill( strip );
+    }
+
+    /* draw vertical grid line */
+    strip.identity_matrix();
+    cairo_set_line_width( strip, 2 );
+    cairo_move_to( strip, x_position, window_height * 0.25 / 10.0 );
+    cairo_line_to( strip, x_position, window_height * 8.5 / 10.0 );
+    cairo_set_source_rgba( strip, 0, 0, 0.4, 0.25 );
+    cairo_stroke( strip );
+  }
+
+  cairo_restore( strip );
+}
+
+vector<pair<float, float>> Graph::y_layer_state( const pair<unsigned int, unsigned int> & window_size ) const
+{
+  vector<pair<float, float>> state;
   for ( const auto & x : y_tick_labels_ ) {
-    x.text.draw_centered_at( cairo_, 90, chart_height( x.height, window_size.second ) );
-    cairo_set_source_rgba( cairo_, 0, 0, 0.4, x.intensity );
-    cairo_fill( cairo_ );
+    state.emplace_back( chart_height( x.height, window_size.second ), x.intensity );
+  }
+  return state;
+}
 
-    /* draw horizontal grid line */
-    cairo_identity_matrix( cairo_ );
-    cairo_set_line_width( cairo_, 1 );
-    cairo_move_to( cairo_, 140, chart_height( x.height, window_size.second ) );
-    cairo_line_to( cairo_, window_size.first, chart_height( x.height, window_size.second ) );
-    cairo_set_source_rgba( cairo_, 0, 0, 0.4, 0.25 * x.intensity );
-    cairo_stroke( cairo_ );
+/* would some label or grid line visibly change? */
+bool Graph::y_layer_changed( const vector<pair<float, float>> & state ) const
+{
+  return not ( state.size() == y_layer_drawn_.size()
+	       and equal( state.begin(), state.end(), y_layer_drawn_.begin(),
+			  [] ( const pair<float, float> & a, const pair<float, float> & b ) {
+			    return fabs( a.first - b.first ) < 0.05 and fabs( a.second - b.second ) < 0.5 / 255; } ) );
+}
+
+void Graph::draw_y_layer( const pair<unsigned int, unsigned int> & window_size )
+{
+  /* skip the redraw unless some label or grid line would visibly change */
+  vector<pair<float, float>> state = y_layer_state( window_size );
+
+  if ( not y_layer_changed( state ) ) {
+    return;
   }
 
-  /* draw the cairo surface on the OpenGL display */
-  display_.draw( cairo_.image() );
+  /* labels left unlaid-out while drawing text on the GPU */
+  for ( auto & x : y_tick_labels_ ) {
+    if ( not sdf_text_ and not x.text ) {
+      x.text = tick_labels_.get( label_font_, x.height );
+    }
+  }
 
-  /* draw the data points, including an extension off the right edge */
-  if ( not data_points_.empty() ) {
-    data_points_.emplace_back( t + 20, data_points_.back().second );
-    display_.draw( 1.0, 0.38, 0.0, 0.75, 5.0, 220, data_points_,
-		   [&] ( const pair<float, float> & x ) {
-		     return make_pair( window_size.first - (t - x.first) * window_size.first / logical_width,
-				       chart_height( x.second, window_size.second ) );
-		   } );
-    data_points_.pop_back();
-  }  
+  draw_layer( y_layer_texture_, { { 0, 0, window_size.first, window_size.second } },
+	      [&] ( Cairo & layer ) {
+		layer.mutable_image().clear_transparent();
 
-  /* swap buffers to reveal what has been drawn */
-  display_.swap();
+		const double band_top = layer.origin().second;
+		const double band_bottom = band_top + layer.image().size().second;
+
+		/* go through and paint all the labels that reach this band */
+		for ( const auto & x : y_tick_labels_ ) {
+		  const double height = chart_height( x.height, window_size.second );
+		  if ( height < band_top - y_label_reach or height > band_bottom + y_label_reach ) {
+		    continue;
+		  }
+
+		  if ( not sdf_text_ ) {
+		    x.text->draw_centered_at( layer, 90, height );
+		    cairo_set_source_rgba( layer, 0, 0, 0.4, x.intensity );
+		    cairo_fill( layer );
+		  }
+
+		  /* draw horizontal grid line */
+		  layer.identity_matrix();
+		  cairo_set_line_width( layer, 1 );
+		  cairo_move_to( layer, 140, height );
+		  cairo_line_to( layer, window_size.first, height );
+		  cairo_set_source_rgba( layer, 0, 0, 0.4, 0.25 * x.intensity );
+		  cairo_stroke( layer );
+		}
+	      } );
+
+  y_layer_drawn_ = move( state );
+}
+
+pair<float, float> Graph::x_title_position( const pair<unsigned int, unsigned int> & window_size )
+{
+  return make_pair( 35 + window_size.first / 2, window_size.second * 9.6 / 10.0 );
+}
+
+pair<float, float> Graph::y_title_position( const pair<unsigned int, unsigned int> & window_size )
+{
+  return make_pair( 25, window_size.second * .4375 );
+}
+
+void Graph::set_sdf_text( const bool enabled )
+{
+  if ( enabled and not text_atlas_ ) {
+    text_atlas_.reset( new SdfAtlas() );
+  }
+
+  sdf_text_ = enabled;
+
+  /* the layers hold the text or not, so everything must be redrawn */
+  display_.make_current();
+  resize( display_.size() );
+}
+
+void Graph::add_text( const Pango::Font & font, const string & text, const pair<float, float> & center,
+		      const float angle, const float alpha )
+{
+  for ( const auto & quad : text_atlas_->layout( font, text ) ) {
+    text_quads_.push_back( Display::TextQuad( { quad.x, quad.y, quad.width, quad.height,
+						quad.u, quad.v, quad.u_width, quad.v_height,
+						center.first, center.second, angle, alpha } ) );
+  }
+}
+
+void Graph::draw_text( void )
+{
+  display_.draw_text( text_quads_, text_atlas_->texture(), 0, 0, 0.4 );
+  text_quads_.clear();
+}
+
+void Graph::draw_x_tick_text( const float t, const float logical_width,
+			      const pair<unsigned int, unsigned int> & window_size )
+{
+  /* the labels the x strip would hold, at the same positions */
+  const double pixels_per_second = window_size.first / double( logical_width );
+  const double left_edge = t * pixels_per_second - window_size.first;
+
+  const int interval = x_tick_interval( pixels_per_second );
+  const double pixels_per_tick = interval * pixels_per_second;
+
+  const int first_label = to_int( ceil( (left_edge - x_strip_label_reach) / pixels_per_tick ) );
+  const int last_label = to_int( floor( (left_edge + window_size.first + x_strip_label_reach) / pixels_per_tick ) );
+
+  for ( int label = first_label; label <= last_label; label++ ) {
+    add_text( tick_font_, label_formatter_.format( label * interval ),
+	      make_pair( label * pixels_per_tick - left_edge, window_size.second * 9.0 / 10.0 ), 0, 1 );
+  }
+
+  draw_text();
+}
+
+void Graph::set_hud( const bool enabled )
+{
+  if ( enabled and not text_atlas_ ) {
+    text_atlas_.reset( new SdfAtlas() );
+  }
+
+  hud_ = enabled;
+  hud_lines_.clear();
+}
+
+/* the HUD is rewritten this often (so it can be read) */
+static const size_t hud_refresh_frames = 30;
+
+void Graph::draw_hud( const pair<unsigned int, unsigned int> & window_size )
+{
+  const size_t frame = profiler_->frame_count();
+
+  if ( hud_lines_.empty() or frame - hud_updated_frame_ >= hud_refresh_frames ) {
+    char line[ 128 ];
+    hud_lines_.clear();
+
+    snprintf( line, sizeof( line ), "frame %6.2f ms   p50 %6.2f   p99 %6.2f",
+	      1000 * profiler_->total_percentile( 1.0, 1 ),
+	      1000 * profiler_->total_percentile( 0.5, hud_frames ),
+	      1000 * profiler_->total_percentile( 0.99, hud_frames ) );
+    hud_lines_.emplace_back( line );
+
+    snprintf( line, sizeof( line ), "cpu   overlay %5.2f  upload %5.2f  submit %5.2f",
+	      1000 * profiler_->percentile( Profiler::Overlay, 0.5, hud_frames ),
+	      1000 * profiler_->percentile( Profiler::Upload, 0.5, hud_frames ),
+	      1000 * profiler_->percentile( Profiler::Submit, 0.5, hud_frames ) );
+    hud_lines_.emplace_back( line );
+
+    snprintf( line, sizeof( line ), "gpu   layers  %5.2f  lines  %5.2f  text   %5.2f",
+	      1000 * profiler_->gpu_percentile( Profiler::Layers, 0.5, hud_frames ),
+	      1000 * profiler_->gpu_percentile( Profiler::Lines, 0.5, hud_frames ),
+	      1000 * profiler_->gpu_percentile( Profiler::Text, 0.5, hud_frames ) );
+    hud_lines_.emplace_back( line );
+
+    snprintf( line, sizeof( line ), "%9.0f vertices %9.1f kB uploaded",
+	      profiler_->mean_vertices( hud_frames ), profiler_->mean_uploaded( hud_frames ) / 1024 );
+    hud_lines_.emplace_back( line );
+
+    hud_updated_frame_ = frame;
+  }
+
+  /* left-aligned (layouts are centered) in the top right corner */
+  static const float hud_width = 420, line_height = 18;
+  const float left = window_size.first - hud_width;
+
+  for ( size_t i = 0; i < hud_lines_.size(); i++ ) {
+    float ink_left = 0;
+    for ( const auto & quad : text_atlas_->layout( hud_font_, hud_lines_[ i ] ) ) {
+      ink_left = min( ink_left, quad.x );
+    }
+
+    add_text( hud_font_, hud_lines_[ i ], make_pair( left - ink_left, 20 + i * line_height ), 0, 1 );
+  }
+
+  draw_text();
+}
+
+void Graph::set_overlay_threads( const unsigned int thread_count )
+{
+  overlay_pool_.reset( new WorkerPool( thread_count ) );
+}
+
+void Graph::draw_layer( Texture & layer, const vector<PixelUnpackRing::Region> & regions,
+			const function<void( Cairo & )> & draw )
+{
+  const auto size = layer.size();
+  const size_t stride_pixels = Cairo::stride_pixels_for_width( size.first );
+
+  /* the mapped buffer's contents are undefined until drawn over */
+  Pixel * pixels;
+  {
+    ScopedTimer timer( profiler_, Profiler::Upload );
+    pixels = reinterpret_cast<Pixel *>( pixel_unpack_ring_.map( stride_pixels * size.second * sizeof( Pixel ) ) );
+  }
+
+  /* one horizontal band per thread, each with its own surface over its rows */
+  {
+    ScopedTimer timer( profiler_, Profiler::Overlay );
+
+    const unsigned int threads = min( overlay_pool_->thread_count(), size.second );
+    const unsigned int band_height = (size.second + threads - 1) / threads;
+    const unsigned int bands = (size.second + band_height - 1) / band_height;
+
+    overlay_pool_->run( bands, [&] ( const size_t band ) {
+	const unsigned int top = band * band_height;
+	const unsigned int height = min( band_height, size.second - top );
+	Cairo cairo( make_pair( size.first, height ), pixels + top * stride_pixels, make_pair( 0, top ) );
+	draw( cairo );
+	cairo.finish();
+      } );
+  }
+
+  ScopedTimer timer( profiler_, Profiler::Upload );
+  pixel_unpack_ring_.upload( layer, stride_pixels, regions );
+}
+
+bool Graph::quit_requested( void ) const
+{
+  return display_.window().key_pressed( GLFW_KEY_ESCAPE ) or display_.window().should_close();
+}
+
+bool Graph::wait_for_events( void )
+{
+  frame_drawn_ = false;
+  Window::wait_events( idle_timeout );
+  return quit_requested();
+}
+
+bool Graph::unchanged_since_drawn( const float t, const float logical_width,
+				   const pair<unsigned int, unsigned int> & window_size,
+				   const AffineTransform & transform ) const
+{
+  if ( not shown_.valid
+       or t != shown_.t or logical_width != shown_.logical_width
+       or window_size != shown_.window_size or data_version_ != shown_.data_version ) {
+    return false;
+  }
+
+  /* the scale is still settling if the top or bottom of the range moved by a visible amount */
+  for ( const float value : { bottom_, top_ } ) {
+    if ( fabs( (value * transform.y_scale + transform.y_offset)
+	       - (value * shown_.transform.y_scale + shown_.transform.y_offset) ) >= 0.05 ) {
+      return false;
+    }
+  }
+
+  return not y_layer_changed( y_layer_state( window_size ) );
+}
+
+bool Graph::blocking_draw( const float t, const float logical_width )
+{
+  if ( not render( t, logical_width ) ) {
+    return wait_for_events();
+  }
+
+  present();
 
   /* should we quit? */
   glfwPollEvents();
 
-  if ( display_.window().key_pressed( GLFW_KEY_ESCAPE ) or display_.window().should_close() ) {
-    return true;
+  return quit_requested();
+}
+
+bool Graph::render( const float t, const float logical_width )
+{
+  display_.make_current();
+
+  /* anything posted from here on will interrupt an idle wait */
+  wakeup_->clear();
+
+  /* take everything the producers have queued, in one batch */
+  ingest();
+
+  Window & window = display_.window();
+  const bool damaged = window.take_damage();
+
+  /* nothing to show while iconified */
+  if ( idle_ and window.iconified() ) {
+    frame_drawn_ = false;
+    return false;
   }
 
-  return false;
+  /* get the current window (or offscreen framebuffer) size */
+  const auto window_size = display_.size();
+
+  /* do we need to resize? */
+  if ( window_size != static_layer_texture_.size() ) {
+    resize( window_size );
+  }
+
+  /* long windows are drawn from each series' history, a min and max per pixel column */
+  const bool from_history = history_needed( t, logical_width, window_size.first );
+  if ( from_history ) {
+    ScopedTimer timer( profiler_, Profiler::Geometry );
+    update_envelopes( t, logical_width, window_size.first );
+  }
+
+  autoscale( from_history );
+  update_y_tick_labels();
+
+  const AffineTransform transform = data_to_window( t, logical_width, window_size );
+
+  /* in idle mode, skip frames that would look just like the last one */
+  if ( idle_ and not damaged and unchanged_since_drawn( t, logical_width, window_size, transform ) ) {
+    frame_drawn_ = false;
+    return false;
+  }
+
+  /* bring each layer up to date */
+  if ( not static_layer_valid_ ) {
+    draw_static_layer( window_size );
+  }
+
+  const float x_scroll = draw_x_strip( t, logical_width, window_size );
+  draw_y_layer( window_size );
+
+  /* composite the layers on the OpenGL display, each with its text if the GPU draws that */
+  display_.composite( x_strip_texture_, false, x_scroll );
+  if ( sdf_text_ ) {
+    draw_x_tick_text( t, logical_width, window_size );
+  }
+
+  display_.composite( static_layer_texture_, true );
+  if ( sdf_text_ ) {
+    add_text( label_font_, x_title, x_title_position( window_size ), 0, 1 );
+    add_text( label_font_, y_title, y_title_position( window_size ), -M_PI / 2, 1 );
+    draw_text();
+  }
+
+  display_.composite( y_layer_texture_, true );
+  if ( sdf_text_ ) {
+    for ( const auto & x : y_tick_labels_ ) {
+      add_text( label_font_, label_formatter_.format( x.height ),
+		make_pair( 90, chart_height( x.height, window_size.second ) ), 0, x.intensity );
+    }
+    draw_text();
+  }
+
+  /* draw the data points, including an extension off the right edge */
+  if ( series_.size() == 1 ) {
+    const Series & x = series_.front();
+    const SampleRing & points = from_history ? x.envelope : x.points;
+    if ( not points.empty() ) {
+      display_.draw( x.red, x.green, x.blue, x.alpha, x.width, 220, points, t + 20, transform );
+    }
+  } else {
+    series_to_draw_.clear();
+    for ( const auto & x : series_ ) {
+      series_to_draw_.push_back( Display::Series( { from_history ? &x.envelope : &x.points, x.red, x.green, x.blue, x.alpha, x.width } ) );
+    }
+
+    display_.draw_batch( series_to_draw_, 220, t + 20, transform );
+  }
+
+  if ( hud_ and profiler_ ) {
+    draw_hud( window_size );
+  }
+
+  shown_ = ShownState( { t, logical_width, window_size, data_version_, transform, true } );
+  frame_drawn_ = true;
+
+  return true;
+}
+
+void Graph::present( void )
+{
+  display_.make_current();
+
+  /* swap buffers to reveal what has been drawn */
+  display_.swap();
+
+  if ( profiler_ ) {
+    profiler_->end_frame();
+  }
 }
@@ -1,13 +1,40 @@
 #ifndef GRAPH_HH
 #define GRAPH_HH
 
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <functional>
+
 #include "display.hh"
 #include "cairo_objects.hh"
+#include "sample_ring.hh"
+#include "sliding_extremes.hh"
+#include "history_pyramid.hh"
+#include "label_cache.hh"
+#include "sample_queue.hh"
+#include "worker_pool.hh"
+#include "sdf_atlas.hh"
 
 class Graph
 {
   Display display_;
-  Cairo cairo_;
+
+  /* the overlay is composited from three layers, bottom to top:
+     a wrap-around strip holding the x ticks and vertical grid (scrolled,
+     and only newly exposed columns are drawn), a static layer with the
+     axis titles and the fadeout box (drawn once per resize), and the
+     y ticks with horizontal grid (redrawn only when they visibly move).
+     layers live only in their textures; each redraw renders straight
+     into a mapped pixel-unpack buffer. */
+  Texture x_strip_texture_;
+  Texture static_layer_texture_;
+  Texture y_layer_texture_;
+
+  PixelUnpackRing pixel_unpack_ring_;
+
+  /* scratch surface for laying out text */
+  Cairo text_cairo_;
   Pango pango_;
 
   Pango::Font tick_font_;
@@ -16,13 +43,34 @@ class Graph
   struct YLabel
   {
     int height;
-    Pango::Text text;
+    LabelCache::Label text;
     float intensity;
   };
 
-  std::deque<std::pair<int, Pango::Text>> x_tick_labels_;
+  LabelCache tick_labels_;
   std::vector<YLabel> y_tick_labels_;
-  std::deque<std::pair<float, float>> data_points_;
+  struct Series
+  {
+    SampleRing points;
+    SlidingExtremes extremes;
+
+    /* everything ever added, summarized for windows the points don't
+       cover (or cover too densely), and this frame's min and max per
+       column from it, drawn instead of the points */
+    HistoryPyramid history;
+    SampleRing envelope;
+
+    float red, green, blue, alpha;
+    float width;
+  };
+
+  size_t data_capacity_;
+  std::vector<Series> series_;
+  std::vector<Display::Series> series_to_draw_;
+  std::vector<HistoryPyramid::Envelope> envelope_columns_;
+
+  bool history_needed( const float t, const float logical_width, const unsigned int columns ) const;
+  void update_envelopes( const float t, const float logical_width, const unsigned int columns );
 
   Pango::Text x_label_;
   Pango::Text y_label_;
@@ -38,12 +86,221 @@ class Graph
 
   Cairo::Pattern horizontal_fadeout_;
 
+  /* columns of the x strip, in absolute pixels (time * pixels per second) */
+  double x_strip_pixels_per_second_;
+  int64_t x_strip_valid_from_, x_strip_valid_until_;
+
+  bool static_layer_valid_;
+
+  /* (chart height, intensity) of each y label as last drawn */
+  std::vector<std::pair<float, float>> y_layer_drawn_;
+
+  /* rasterizes the overlay layers in horizontal bands */
+  std::unique_ptr<WorkerPool> overlay_pool_;
+
+  Profiler * profiler_;
+
+  /* samples from other threads, each through its own queue */
+  struct Producer
+  {
+    size_t series;
+    std::shared_ptr<SampleQueue> queue;
+  };
+
+  mutable std::mutex producers_mutex_;
+  std::vector<Producer> producers_;
+  std::vector<SampleQueue::Sample> ingest_batch_;
+  size_t last_ingest_size_;
+
+  void ingest( void );
+
+  /* in idle mode, frames are drawn only when they would look different,
+     and otherwise the drawing thread sleeps until an event, new data
+     from a producer, or a timeout. producers' queues (which post to
+     it) can outlive the graph, so they share it, and it is closed first. */
+  std::shared_ptr<EventWakeup> wakeup_;
+  bool idle_;
+  uint64_t data_version_; /* counts additions of data */
+
+  /* what the last frame drawn showed */
+  struct ShownState
+  {
+    float t, logical_width;
+    std::pair<unsigned int, unsigned int> window_size;
+    uint64_t data_version;
+    AffineTransform transform;
+    bool valid;
+  } shown_;
+
+  bool frame_drawn_;
+
+  bool unchanged_since_drawn( const float t, const float logical_width,
+			      const std::pair<unsigned int, unsigned int> & window_size,
+			      const AffineTransform & transform ) const;
+  bool wait_for_events( void );
+
+  /* with distance-field text, the layers hold no text; the GPU draws
+     it over each one from an atlas of glyphs rasterized once */
+  bool sdf_text_;
+  std::unique_ptr<SdfAtlas> text_atlas_;
+  LabelFormatter label_formatter_;
+  std::vector<Display::TextQuad> text_quads_;
+
+  static std::pair<float, float> x_title_position( const std::pair<unsigned int, unsigned int> & window_size );
+  static std::pair<float, float> y_title_position( const std::pair<unsigned int, unsigned int> & window_size );
+
+  void add_text( const Pango::Font & font, const std::string & text, const std::pair<float, float> & center,
+		 const float angle, const float alpha );
+  void draw_text( void );
+  void draw_x_tick_text( const float t, const float logical_width,
+			 const std::pair<unsigned int, unsigned int> & window_size );
+
+  /* frame statistics from the profiler, drawn over everything (with the same atlas) */
+  bool hud_;
+  Pango::Font hud_font_;
+  std::vector<std::string> hud_lines_;
+  size_t hud_updated_frame_;
+
+  void draw_hud( const std::pair<unsigned int, unsigned int> & window_size );
+
+  static std::pair<unsigned int, unsigned int> x_strip_size( const std::pair<unsigned int, unsigned int> & window_size );
+
+  void resize( const std::pair<unsigned int, unsigned int> & window_size );
+  void autoscale( const bool from_history );
+  void update_y_tick_labels( void );
+
+  void draw_static_layer( const std::pair<unsigned int, unsigned int> & window_size );
+  float draw_x_strip( const float t, const float logical_width,
+		      const std::pair<unsigned int, unsigned int> & window_size );
+
+  /* newly exposed strip columns [first, last), which start at base in absolute pixels,
+     with the labels (strip position, text) that reach them */
+  struct XStripRun
+  {
+    int64_t first, last, base;
+    std::vector<std::pair<double, LabelCache::Label>> labels;
+  };
+
+  void draw_x_strip_columns( Cairo & strip, const XStripRun & run, const unsigned int window_height );
+
+  std::vector<std::pair<float, float>> y_layer_state( const std::pair<unsigned int, unsigned int> & window_size ) const;
+  bool y_layer_changed( const std::vector<std::pair<float, float>> & state ) const;
+  void draw_y_layer( const std::pair<unsigned int, unsigned int> & window_size );
+
+  /* draw a layer into a mapped pixel-unpack buffer, split into horizontal
+     bands drawn in parallel (draw runs once per band, on any thread, and
+     sees whole-layer coordinates), then upload the given regions of it */
+  void draw_layer( Texture & layer, const std::vector<PixelUnpackRing::Region> & regions,
+		   const std::function<void( Cairo & )> & draw );
+
+  AffineTransform data_to_window( const float t, const float logical_width,
+				  const std::pair<unsigned int, unsigned int> & window_size ) const;
+
 public:
-  Graph( const unsigned int initial_width, const unsigned int initial_height, const std::string & title );
+  /* the HUD summarizes this many recent frames */
+  static constexpr size_t hud_frames = 120;
+
+  Graph( const unsigned int initial_width, const unsigned int initial_height, const std::string & title,
+	 const size_t data_capacity = 65536, const bool offscreen = false,
+	 const Display::Antialiasing antialiasing = Display::Antialiasing::Multisample );
+
+  /* one of many graphs sharing a context's programs (see Renderer), or on its own if shared is null */
+  Graph( SharedContext * const shared,
+	 const unsigned int initial_width, const unsigned int initial_height, const std::string & title,
+	 const size_t data_capacity = 65536, const bool offscreen = false,
+	 const Display::Antialiasing antialiasing = Display::Antialiasing::Multisample );
 
   void set_window( const float t, const float logical_width );
-  void add_data_point( const float t, const float y ) { data_points_.emplace_back( t, y ); }
+
+  /* series 0 always exists; more are added with their color and line width,
+     and all of them are drawn together in one batch */
+  size_t add_series( const float red, const float green, const float blue, const float alpha,
+		     const float width = 5.0 );
+
+  /* the same, with the next color from a built-in palette */
+  size_t add_series( const float width = 3.0 );
+  size_t series_count( void ) const { return series_.size(); }
+
+  void add_data_point( const float t, const float y ) { add_data_point( 0, t, y ); }
+  void add_data_point( const size_t series, const float t, const float y );
+
+  /* many samples, in time order, copied straight into the series' storage */
+  void add_data_points( const size_t series, const float * times, const float * values, const size_t count );
+
+  /* a queue another thread can push samples for a series into without
+     ever blocking; they are added at the start of the next frame, in time order */
+  std::shared_ptr<SampleQueue> add_producer( const size_t capacity = 65536, const size_t series = 0 );
+
+  struct IngestStats
+  {
+    size_t producers;
+    size_t occupancy;      /* samples currently queued */
+    size_t peak_occupancy; /* worst per-queue occupancy seen at a frame start */
+    size_t capacity;
+    uint64_t dropped;      /* samples lost to full queues */
+    size_t last_batch;     /* samples added at the last frame start */
+  };
+
+  /* call from the drawing thread */
+  IngestStats ingest_stats( void ) const;
+
+  /* draw a frame and process events; returns true if the user asked to quit */
   bool blocking_draw( const float t, const float logical_width );
+
+  /* the parts of blocking_draw(), for drawing many graphs at once: bring
+     everything up to date and draw it (in idle mode, only if something
+     visible changed), returning whether it drew; then, if it did, swap */
+  bool render( const float t, const float logical_width );
+  void present( void );
+
+  /* has the user asked to close this graph's window? */
+  bool quit_requested( void ) const;
+
+  /* how many refreshes present() waits for (0 or 1; the default is 1 onscreen) */
+  void set_swap_interval( const int interval ) { display_.set_swap_interval( interval ); }
+
+  /* draw only when something visible changes, and not at all while iconified */
+  void set_idle( const bool idle ) { idle_ = idle; }
+
+  /* in idle mode, wait at most this long (seconds) for an event before returning to the caller */
+  static constexpr double idle_timeout = 0.25;
+
+  /* did the last blocking_draw() or render() draw a frame (rather than wait, in idle mode)? */
+  bool frame_drawn( void ) const { return frame_drawn_; }
+
+  /* make an idle blocking_draw() return early; any thread (producers' queues do this themselves) */
+  void wake( void ) { wakeup_->post(); }
+
+  void set_line_mode( const Display::LineMode mode ) { display_.set_line_mode( mode ); }
+  void set_decimation( const bool enabled ) { display_.set_decimation( enabled ); }
+
+  /* draw text on the GPU from a signed-distance-field atlas, instead of into the layers with Cairo */
+  void set_sdf_text( const bool enabled );
+
+  /* rasterize the overlay on this many threads (1, the default, draws it all on this one) */
+  void set_overlay_threads( const unsigned int thread_count );
+
+  /* show the profiler's recent statistics in a corner of each frame */
+  void set_hud( const bool enabled );
+
+  /* time each stage of every frame into the profiler (or stop, if null) */
+  void set_profiler( Profiler * const profiler ) { profiler_ = profiler; display_.set_profiler( profiler ); }
+  void set_synchronous_swap( const bool synchronous ) { display_.set_synchronous_swap( synchronous ); }
+
+  /* seconds between display refreshes, or 0 if drawing isn't paced by them */
+  double refresh_interval( void ) const { return display_.refresh_interval(); }
+
+  /* offscreen, write every frame presented to a video (null stops, and writes the last ones) */
+  void set_video_writer( VideoWriter * const writer ) { display_.set_video_writer( writer ); }
+
+  /* copy out the last frame drawn (offscreen only) */
+  void read_frame( Image & image ) { display_.read_frame( image ); }
+
+  ~Graph();
+
+  /* forbid copy */
+  Graph( const Graph & other ) = delete;
+  Graph & operator=( const Graph & other ) = delete;
 };
 
 #endif /* GRAPH_HH */
@@ -0,0 +1,145 @@
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+
+#include "history_pyramid.hh"
+
+using namespace std;
+
+HistoryPyramid::HistoryPyramid( const double base_width, const size_t level_count,
+				const size_t buckets_per_level )
+  : base_width_( base_width ),
+    buckets_per_level_( buckets_per_level ),
+    levels_( level_count )
+{
+  if ( base_width_ <= 0 or level_count == 0 or buckets_per_level_ == 0 ) {
+    throw runtime_error( "HistoryPyramid: bad dimensions" );
+  }
+}
+
+double HistoryPyramid::width( const size_t level ) const
+{
+  return ldexp( base_width_, level );
+}
+
+void HistoryPyramid::add( const float t, const float y )
+{
+  const int64_t base_index = int64_t( floor( t / base_width_ ) );
+
+  for ( size_t level = 0; level < levels_.size(); level++ ) {
+    deque<Bucket> & buckets = levels_[ level ];
+
+    /* buckets nest, so this is the bucket at this level holding the one below */
+    const int64_t index = base_index >> level;
+
+    if ( buckets.empty() or buckets.back().index < index ) {
+      buckets.push_back( Bucket( { index, y, y } ) );
+      if ( buckets.size() > buckets_per_level_ ) {
+	buckets.pop_front();
+      }
+      continue;
+    }
+
+    if ( buckets.back().index == index ) {
+      Bucket & bucket = buckets.back();
+
+      /* within what the newest bucket already holds, which every coarser one holds too */
+      if ( y >= bucket.min and y <= bucket.max ) {
+	return;
+      }
+
+      bucket.min = min( bucket.min, y );
+      bucket.max = max( bucket.max, y );
+      continue;
+    }
+
+    /* out of order: into the middle, unless it is older than this level keeps */
+    const auto it = lower_bound( buckets.begin(), buckets.end(), index,
+				 [] ( const Bucket & b, const int64_t x ) { return b.index < x; } );
+    if ( it == buckets.begin() and it->index != index and buckets.size() == buckets_per_level_ ) {
+      continue;
+    }
+
+    if ( it->index == index ) {
+      it->min = min( it->min, y );
+      it->max = max( it->max, y );
+    } else {
+      buckets.insert( it, Bucket( { index, y, y } ) );
+      if ( buckets.size() > buckets_per_level_ ) {
+	buckets.pop_front();
+      }
+    }
+  }
+}
+
+double HistoryPyramid::earliest( void ) const
+{
+  double ret = 0;
+  bool any = false;
+  for ( size_t level = 0; level < levels_.size(); level++ ) {
+    if ( not levels_[ level ].empty() ) {
+      const double start = levels_[ level ].front().index * width( level );
+      ret = any ? min( ret, start ) : start;
+      any = true;
+    }
+  }
+  return ret;
+}
+
+size_t HistoryPyramid::level_for( const double start, const double column_width ) const
+{
+  /* the coarsest level whose buckets are no wider than a column */
+  size_t level = 0;
+  while ( level + 1 < levels_.size() and width( level + 1 ) <= column_width ) {
+    level++;
+  }
+
+  /* but coarser still if that one has already forgotten the start of the window */
+  while ( level + 1 < levels_.size() and not levels_[ level ].empty()
+	  and levels_[ level ].size() == buckets_per_level_
+	  and levels_[ level ].front().index * width( level ) > start ) {
+    level++;
+  }
+
+  return level;
+}
+
+void HistoryPyramid::envelopes( const double start, const double end, vector<Envelope> & out ) const
+{
+  const size_t columns = out.size();
+  fill( out.begin(), out.end(), Envelope( { 1, 0 } ) );
+
+  if ( columns == 0 or end <= start ) {
+    return;
+  }
+
+  const double column_width = (end - start) / columns;
+  const size_t level = level_for( start, column_width );
+  const deque<Bucket> & buckets = levels_[ level ];
+  const double bucket_width = width( level );
+
+  /* the first bucket whose middle is in the window, then each in turn to the column holding its middle */
+  const int64_t first_index = int64_t( floor( start / bucket_width - 0.5 ) );
+  auto it = lower_bound( buckets.begin(), buckets.end(), first_index,
+			 [] ( const Bucket & b, const int64_t x ) { return b.index < x; } );
+
+  for ( ; it != buckets.end(); ++it ) {
+    const double middle = (it->index + 0.5) * bucket_width;
+    if ( middle < start ) {
+      continue;
+    }
+
+    const size_t column = size_t( (middle - start) / column_width );
+    if ( column >= columns ) {
+      break;
+    }
+
+    Envelope & envelope = out[ column ];
+    if ( envelope.empty() ) {
+      envelope = Envelope( { it->min, it->max } );
+    } else {
+      envelope.min = min( envelope.min, it->min );
+      envelope.max = max( envelope.max, it->max );
+    }
+  }
+}
@@ -0,0 +1,62 @@
+#ifndef HISTORY_PYRAMID_HH
+#define HISTORY_PYRAMID_HH
+
+#include <vector>
+#include <deque>
+#include <cstdint>
+#include <cstddef>
+
+/* a long history of one series, kept as the minimum and maximum of
+   time buckets at every power-of-two width (like a mipmap): level k's
+   buckets are base_width * 2^k seconds wide and aligned to multiples of
+   that, and each level keeps only its newest buckets, so the coarse
+   levels reach back furthest. any window, at any zoom, can then be
+   summarized per pixel column from a level with about one bucket per
+   column, whatever the number of samples behind it. */
+
+class HistoryPyramid
+{
+public:
+  /* the extremes of one column, or empty (min > max) if it had no samples */
+  struct Envelope
+  {
+    float min, max;
+
+    bool empty( void ) const { return min > max; }
+  };
+
+private:
+  struct Bucket
+  {
+    int64_t index; /* the bucket covers [index, index + 1) * its level's width */
+    float min, max;
+  };
+
+  double base_width_;
+  size_t buckets_per_level_;
+
+  std::vector<std::deque<Bucket>> levels_; /* buckets in increasing index order */
+
+  double width( const size_t level ) const;
+
+  /* the level with about one bucket per column_width that still reaches back to start */
+  size_t level_for( const double start, const double column_width ) const;
+
+public:
+  HistoryPyramid( const double base_width = 1.0 / 256, const size_t level_count = 20,
+		  const size_t buckets_per_level = 4096 );
+
+  /* samples may arrive slightly out of order, but mostly don't */
+  void add( const float t, const float y );
+
+  /* the envelope of each of out.size() equal columns of [start, end) */
+  void envelopes( const double start, const double end, std::vector<Envelope> & out ) const;
+
+  bool empty( void ) const { return levels_.front().empty(); }
+  double base_width( void ) const { return base_width_; }
+
+  /* the start of the oldest bucket kept at any level */
+  double earliest( void ) const;
+};
+
+#endif /* HISTORY_PYRAMID_HH */
@@ -11,20 +11,46 @@ Image::Image( const unsigned int width,
   : width_( width ),
     height_( height ),
     stride_pixels_( stride_pixels ),
+    storage_(),
     pixels_()
 {
   if ( stride_pixels_ < width ) {
     throw runtime_error( "invalid stride in Image constructor" );
   }
-  pixels_.reserve( stride_pixels * height );
+  storage_.reserve( stride_pixels * height );
   for ( unsigned int y = 0; y < height; y++ ) {
     for ( unsigned int x = 0; x < stride_pixels; x++ ) {
-      pixels_.emplace_back();
+      storage_.emplace_back();
     }
   }
+  pixels_ = &storage_.front();
+}
+
+Image::Image( const unsigned int width,
+	      const unsigned int height,
+	      const unsigned int stride_pixels,
+	      Pixel * const external_pixels )
+  : width_( width ),
+    height_( height ),
+    stride_pixels_( stride_pixels ),
+    storage_(),
+    pixels_( external_pixels )
+{
+  if ( stride_pixels_ < width ) {
+    throw runtime_error( "invalid stride in Image constructor" );
+  }
+
+  if ( not pixels_ ) {
+    throw runtime_error( "null pixels in Image constructor" );
+  }
 }
 
 void Image::clear( void )
 {
-  memset( raw_pixels(), 255, pixels_.size() * sizeof( Pixel ) );
+  memset( raw_pixels(), 255, stride_bytes() * height_ );
+}
+
+void Image::clear_transparent( void )
+{
+  memset( raw_pixels(), 0, stride_bytes() * height_ );
 }
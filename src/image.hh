@@ -10,20 +10,36 @@ class Image
 {
   unsigned int width_, height_, stride_pixels_;
 
-  std::vector<Pixel> pixels_;
+  std::vector<Pixel> storage_; /* empty when viewing someone else's memory */
+  Pixel * pixels_;
 
 public:
   Image( const unsigned int width,
 	 const unsigned int height,
 	 const unsigned int stride_pixels );
 
+  /* view of external memory (e.g. a mapped pixel buffer) that must outlive the Image */
+  Image( const unsigned int width,
+	 const unsigned int height,
+	 const unsigned int stride_pixels,
+	 Pixel * const external_pixels );
+
   std::pair<unsigned int, unsigned int> size( void ) const { return std::make_pair( width_, height_ ); }
-  const std::vector<Pixel> & pixels( void ) const { return pixels_; }
-  unsigned char * raw_pixels( void ) { return reinterpret_cast<unsigned char *>( &pixels_.front() ); }
+  const Pixel * pixels( void ) const { return pixels_; }
+  unsigned char * raw_pixels( void ) { return reinterpret_cast<unsigned char *>( pixels_ ); }
 
   unsigned int stride_pixels( void ) const { return stride_pixels_; }
   unsigned int stride_bytes( void ) const { return stride_pixels_ * sizeof( Pixel ); }
-  void clear( void );
+  void clear( void );             /* opaque white */
+  void clear_transparent( void );
+
+  /* moving keeps the vector's buffer, so the pointer stays valid */
+  Image( Image && other ) = default;
+  Image & operator=( Image && other ) = default;
+
+  /* forbid copy */
+  Image( const Image & other ) = delete;
+  Image & operator=( const Image & other ) = delete;
 };
 
 #endif /* IMAGE_HH */
@@ -0,0 +1,154 @@
+#include <locale>
+
+#include "label_cache.hh"
+
+using namespace std;
+
+LabelFormatter::LabelFormatter()
+  : stream_()
+{
+  /* look up the locale once, not per label */
+  stream_.imbue( locale( "" ) );
+  stream_ << fixed;
+}
+
+string LabelFormatter::format( const int value )
+{
+  stream_.str( string() );
+  stream_.clear();
+  stream_ << value;
+  return stream_.str();
+}
+
+LabelCache::LabelCache( const size_t capacity )
+  : capacity_( capacity ),
+    entries_(),
+    index_(),
+    cairo_( make_pair( 1, 1 ) ),
+    pango_( cairo_ ),
+    formatter_(),
+    mutex_(),
+    work_available_(),
+    requests_(),
+    pending_(),
+    shutting_down_( false ),
+    hits_( 0 ),
+    misses_( 0 ),
+    prefetched_( 0 ),
+    worker_()
+{
+  /* start the worker last, once everything it touches exists */
+  worker_ = thread( [this] () { work(); } );
+}
+
+LabelCache::~LabelCache()
+{
+  {
+    unique_lock<mutex> lock( mutex_ );
+    shutting_down_ = true;
+  }
+
+  work_available_.notify_all();
+  worker_.join();
+}
+
+void LabelCache::insert( const Key & key, const Label & label )
+{
+  /* caller holds the lock */
+  if ( index_.count( key ) ) {
+    return;
+  }
+
+  entries_.push_front( Entry( { key, label } ) );
+  index_[ key ] = entries_.begin();
+
+  while ( entries_.size() > capacity_ ) {
+    index_.erase( entries_.back().key );
+    entries_.pop_back();
+  }
+}
+
+LabelCache::Label LabelCache::get( const Pango::Font & font, const int value )
+{
+  const Key key( font.description, value );
+
+  {
+    unique_lock<mutex> lock( mutex_ );
+
+    const auto it = index_.find( key );
+    if ( it != index_.end() ) {
+      hits_++;
+      entries_.splice( entries_.begin(), entries_, it->second );
+      return it->second->label;
+    }
+
+    misses_++;
+  }
+
+  /* not prepared in time: lay it out here rather than wait for the worker */
+  const Label label = make_shared<const Pango::Text>( cairo_, pango_, font, formatter_.format( value ) );
+
+  unique_lock<mutex> lock( mutex_ );
+  insert( key, label );
+  return label;
+}
+
+void LabelCache::prefetch( const Pango::Font & font, const int value )
+{
+  const Key key( font.description, value );
+
+  {
+    unique_lock<mutex> lock( mutex_ );
+
+    if ( index_.count( key ) or pending_.count( key ) ) {
+      return;
+    }
+
+    pending_.insert( key );
+    requests_.push_back( key );
+  }
+
+  work_available_.notify_one();
+}
+
+void LabelCache::work( void )
+{
+  /* Pango is used only with a context and layout private to this thread */
+  Cairo cairo( make_pair( 1, 1 ) );
+  Pango pango( cairo );
+  LabelFormatter formatter;
+  map<string, Pango::Font> fonts;
+
+  while ( true ) {
+    Key key;
+
+    {
+      unique_lock<mutex> lock( mutex_ );
+      work_available_.wait( lock, [&] () { return shutting_down_ or not requests_.empty(); } );
+
+      if ( shutting_down_ ) {
+	return;
+      }
+
+      key = requests_.front();
+      requests_.pop_front();
+
+      if ( index_.count( key ) ) {
+	pending_.erase( key );
+	continue;
+      }
+    }
+
+    auto font = fonts.find( key.first );
+    if ( font == fonts.end() ) {
+      font = fonts.emplace( key.first, Pango::Font( key.first ) ).first;
+    }
+
+    const Label label = make_shared<const Pango::Text>( cairo, pango, font->second, formatter.format( key.second ) );
+
+    unique_lock<mutex> lock( mutex_ );
+    insert( key, label );
+    pending_.erase( key );
+    prefetched_++;
+  }
+}
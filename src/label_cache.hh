@@ -0,0 +1,92 @@
+#ifndef LABEL_CACHE_HH
+#define LABEL_CACHE_HH
+
+#include <string>
+#include <sstream>
+#include <list>
+#include <map>
+#include <set>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+
+#include "cairo_objects.hh"
+
+/* integers formatted with the user's locale (e.g. thousands separators) */
+class LabelFormatter
+{
+  std::ostringstream stream_;
+
+public:
+  LabelFormatter();
+
+  std::string format( const int value );
+};
+
+/* LRU cache of laid-out tick labels, keyed by font and value. labels
+   predicted to be needed soon can be laid out ahead of time on a
+   worker thread (with its own Cairo and Pango), so a frame only pays
+   for Pango on a misprediction. */
+class LabelCache
+{
+public:
+  typedef std::shared_ptr<const Pango::Text> Label;
+
+private:
+  typedef std::pair<std::string, int> Key; /* font description, value */
+
+  struct Entry
+  {
+    Key key;
+    Label label;
+  };
+
+  size_t capacity_;
+
+  /* most recently used at the front */
+  std::list<Entry> entries_;
+  std::map<Key, std::list<Entry>::iterator> index_;
+
+  /* used on the calling thread */
+  Cairo cairo_;
+  Pango pango_;
+  LabelFormatter formatter_;
+
+  /* shared with the worker */
+  std::mutex mutex_;
+  std::condition_variable work_available_;
+  std::deque<Key> requests_;
+  std::set<Key> pending_;
+  bool shutting_down_;
+
+  /* counted under the lock, but read without it */
+  std::atomic<uint64_t> hits_, misses_, prefetched_;
+
+  std::thread worker_;
+
+  void insert( const Key & key, const Label & label );
+  void work( void );
+
+public:
+  LabelCache( const size_t capacity = 256 );
+  ~LabelCache();
+
+  /* the label, laid out on this thread if it isn't already cached */
+  Label get( const Pango::Font & font, const int value );
+
+  /* ask the worker to lay out a label that will probably be needed soon */
+  void prefetch( const Pango::Font & font, const int value );
+
+  uint64_t hits( void ) const { return hits_; }
+  uint64_t misses( void ) const { return misses_; }
+  uint64_t prefetched( void ) const { return prefetched_; }
+
+  /* forbid copy */
+  LabelCache( const LabelCache & other ) = delete;
+  LabelCache & operator=( const LabelCache & other ) = delete;
+};
+
+#endif /* LABEL_CACHE_HH */
@@ -1,8 +1,19 @@
 #include <stdexcept>
 #include <random>
 #include <iostream>
+#include <chrono>
+#include <algorithm>
+
+#include <unistd.h>
 
 #include "graph.hh"
+#include "text_stream.hh"
+#include "trace_file.hh"
+#include "frame_scheduler.hh"
+#include "profiler.hh"
+#include "renderer.hh"
+#include "video_writer.hh"
+#include "options.hh"
 
 using namespace std;
 
@@ -20,38 +31,378 @@ int main( int argc, char *argv[] )
   return EXIT_SUCCESS;
 }
 
-void glfun( int argc, char *argv[] )
+static void usage( const char * argv0 )
 {
-  if ( argc < 1 ) {
-    throw runtime_error( "missing argv[ 0 ]" );
-  } else if ( argc != 1 ) {
-    cerr << "Usage: " << argv[ 0 ] << endl;
-    throw runtime_error( "bad command-line arguments" );
+  cerr << "Usage: " << argv0 << " [--line-mode=immediate|streaming|instanced]"
+       << " [--offscreen] [--frames=N] [--window=SECONDS] [--overlay-threads=N] [--latency] [--idle]" << endl
+       << "       [--stdin [--series=N] [--rate=N] [--write-trace=FILE]] [--replay=FILE [--speed=N|max] [--seek=T]] [--sdf-text]" << endl
+       << "       [--hud] [--stats-csv=FILE] [--graphs=N] [--record=FILE|- [--record-format=y4m|rgb] [--fps=N]]" << endl
+       << "       [--antialiasing=multisample|analytic]" << endl;
+  cerr << "  --stdin plots \"t y [series]\" lines read from standard input (and can record them)" << endl;
+  cerr << "  --rate is how many points per second each series may get, so the whole window is kept" << endl
+       << "    (by default, the last 65536 points of each series)" << endl;
+  cerr << "  --replay plays back a recorded trace, at N times real time or as fast as possible" << endl;
+  cerr << "  --latency starts each frame as late as it can before the display refreshes" << endl;
+  cerr << "  --idle draws only when something visible changes, and not while iconified" << endl;
+  cerr << "  --sdf-text draws the labels on the GPU from a distance-field atlas" << endl;
+  cerr << "  --hud shows frame times (CPU and GPU), vertices and uploads; --stats-csv writes them per frame" << endl;
+  cerr << "  --graphs plots a random walk in each of N windows, drawn together (the profiler watches the first)" << endl;
+  cerr << "  --record renders offscreen at N frames per second of plot time (as fast as it can) and writes" << endl
+       << "    the first graph's frames as Y4M, or bare RGB24 frames, to a file or standard output" << endl;
+  cerr << "  --antialiasing=analytic smooths line edges in the shader instead of with 4x multisampling" << endl
+       << "    (in the instanced line mode only, which it selects)" << endl;
+  throw runtime_error( "bad command-line arguments" );
+}
+
+static void print_pacing( const FrameScheduler & scheduler )
+{
+  const auto & stats = scheduler.statistics();
+  cerr << stats.frames << " frames, " << stats.missed << " missed deadlines ("
+       << stats.skipped << " refreshes without a new frame, worst " << stats.worst_late * 1000 << " ms late)";
+  if ( stats.render_budget > 0 ) {
+    cerr << ", render budget " << stats.render_budget * 1000 << " ms";
+  }
+  cerr << endl;
+}
+
+/* plot "t y [series]" lines from standard input until it ends (if offscreen) or the window closes */
+static void plot_stdin( Graph & graph, FrameScheduler & scheduler, const unsigned int series,
+			const string & trace_filename, const float window, const bool offscreen,
+			const unsigned long frame_limit )
+{
+  unique_ptr<TraceWriter> recording;
+  if ( not trace_filename.empty() ) {
+    recording.reset( new TraceWriter( trace_filename, series ) );
+  }
+
+  vector<shared_ptr<SampleQueue>> queues;
+  for ( unsigned int i = 0; i < series; i++ ) {
+    if ( i > 0 ) {
+      graph.add_series();
+    }
+    queues.push_back( graph.add_producer( 1 << 20, i ) );
+  }
+
+  TextStreamReader reader( STDIN_FILENO, queues, recording.get() );
+
+  unsigned long frames = 0;
+  while ( (frame_limit == 0) or (frames < frame_limit) ) {
+    /* the time axis follows the data, not the clock */
+    scheduler.begin_frame();
+
+    /* whatever was queued before this point is drawn this frame */
+    const bool input_finished = reader.finished();
+    const float t = reader.latest_time();
+
+    graph.set_window( t, window );
+
+    const bool quit = graph.blocking_draw( t, window );
+    scheduler.end_frame( graph.frame_drawn() );
+
+    if ( graph.frame_drawn() ) {
+      frames++;
+    }
+
+    if ( quit or (offscreen and input_finished) ) {
+      break;
+    }
+  }
+
+  const auto stats = reader.statistics();
+  const auto ingest = graph.ingest_stats();
+  cerr << stats.lines << " lines (" << stats.bytes / 1.0e6 << " MB) parsed in " << stats.seconds << " s ("
+       << stats.lines / stats.seconds / 1.0e6 << " M lines/s, "
+       << stats.bytes / stats.seconds / 1.0e6 << " MB/s); "
+       << stats.rejected << " rejected, " << ingest.dropped << " dropped by full queues" << endl;
+
+  if ( recording ) {
+    /* stop the reader before finishing the trace it writes to */
+    reader.stop();
+    recording->finish();
+
+    if ( recording->out_of_order() ) {
+      cerr << recording->out_of_order() << " samples went back in time and were left out of "
+	   << trace_filename << endl;
+    }
   }
+}
+
+/* play a trace at speed times real time (or, if speed is zero, a block at a time as fast as frames go) */
+static void replay_trace( Graph & graph, FrameScheduler & scheduler, const TraceFile & trace,
+			  const double speed, const float seek_to, const bool seeking,
+			  const float window, const bool offscreen, const unsigned long frame_limit )
+{
+  for ( size_t i = 1; i < trace.series_count(); i++ ) {
+    graph.add_series();
+  }
+
+  /* start with a full window of history */
+  const float start = seeking ? seek_to : trace.start_time();
+  TraceReplay replay( trace );
+  replay.seek( start - window - 1 );
+  replay.advance( start, graph );
+
+  const auto start_time = chrono::steady_clock::now();
+  float t = start;
+  unsigned long frames = 0;
 
-  Graph graph( 1024, 768, "Ratatouille" );
+  const double start_offset = scheduler.now();
 
+  while ( (frame_limit == 0) or (frames < frame_limit) ) {
+    const double now = scheduler.begin_frame();
+
+    if ( speed > 0 ) {
+      t = start + speed * (now - start_offset);
+    } else {
+      t = max( t, replay.next_block_end() );
+    }
+
+    const bool trace_finished = replay.finished();
+    replay.advance( t, graph );
+    graph.set_window( t, window );
+
+    const bool quit = graph.blocking_draw( t, window );
+    scheduler.end_frame( graph.frame_drawn() );
+
+    if ( graph.frame_drawn() ) {
+      frames++;
+    }
+
+    if ( quit or (offscreen and trace_finished) ) {
+      break;
+    }
+  }
+
+  const chrono::duration<double> elapsed = chrono::steady_clock::now() - start_time;
+  cerr << replay.replayed() << " of " << trace.sample_count() << " samples replayed in "
+       << elapsed.count() << " s (" << replay.replayed() / elapsed.count() / 1.0e6 << " M samples/s, "
+       << frames << " frames)" << endl;
+}
+
+/* plot a random walk against the clock, a step every 50 ms */
+static void plot_random_walk( Renderer & renderer, FrameScheduler & scheduler, const float window,
+			      const unsigned long frame_limit )
+{
   random_device rd;
   uniform_real_distribution<> dist( -1, 1 );
 
-  float t = 0;
+  const float step_interval = 0.05;
+
+  /* one walk per graph */
+  vector<float> val( renderer.graph_count(), 1024 );
+  float last_x = 0;
 
-  float val = 1024;
-  float last_x = t;
+  const auto start_time = chrono::steady_clock::now();
+  unsigned long frames = 0;
+
+  while ( (frame_limit == 0) or (frames < frame_limit) ) {
+    const float t = scheduler.begin_frame();
+
+    for ( size_t i = 0; i < renderer.graph_count(); i++ ) {
+      renderer.graph( i ).set_window( t, window );
+    }
 
-  while ( true ) {
-    t += 1.0 / 480.0;
+    /* however long the last frame took, take every step due since */
+    while ( t - last_x > step_interval ) {
+      last_x += step_interval;
+      for ( size_t i = 0; i < renderer.graph_count(); i++ ) {
+	val[ i ] += dist( rd ) * last_x;
+	renderer.graph( i ).add_data_point( last_x, val[ i ] );
+      }
+    }
 
-    graph.set_window( t, 3 );
+    const bool quit = renderer.blocking_draw( t, window );
+    scheduler.end_frame( renderer.frames_drawn() > 0 );
 
-    if ( t - last_x > 0.05 ) {
-      val += dist( rd ) * t;
-      graph.add_data_point( t, val );
-      last_x = t;
+    if ( renderer.frames_drawn() > 0 ) {
+      frames++;
     }
 
-    if ( graph.blocking_draw( t, 3 ) ) {
+    if ( quit ) {
       break;
     }
   }
+
+  const chrono::duration<double> elapsed = chrono::steady_clock::now() - start_time;
+  cerr << frames << " frames in " << elapsed.count() << " s ("
+       << frames / elapsed.count() << " frames/s)" << endl;
+}
+
+void glfun( int argc, char *argv[] )
+{
+  if ( argc < 1 ) {
+    throw runtime_error( "missing argv[ 0 ]" );
+  }
+
+  Display::LineMode line_mode = Display::LineMode::Immediate;
+  bool line_mode_given = false;
+  bool offscreen = false;
+  unsigned long frame_limit = 0;
+  float window = 3;
+  bool read_stdin = false;
+  unsigned int series = 1;
+  string write_trace, replay;
+  double speed = 1;
+  float seek_to = 0;
+  bool seeking = false;
+  unsigned int overlay_threads = 1;
+  FrameScheduler::Mode pacing = FrameScheduler::Mode::Vsync;
+  bool idle = false;
+  bool sdf_text = false;
+  bool hud = false;
+  string stats_csv;
+  unsigned int graph_count = 1;
+  string record;
+  VideoWriter::Format record_format = VideoWriter::Format::Y4M;
+  unsigned int fps = 60;
+  double rate = 0;
+  Display::Antialiasing antialiasing = Display::Antialiasing::Multisample;
+
+  for ( int i = 1; i < argc; i++ ) {
+    const string arg = argv[ i ];
+    string value;
+
+    if ( option_value( arg, "--line-mode", value ) ) {
+      if ( not parse_line_mode( value, line_mode ) ) {
+	usage( argv[ 0 ] );
+      }
+      line_mode_given = true;
+    } else if ( arg == "--offscreen" ) {
+      offscreen = true;
+    } else if ( option_value( arg, "--frames", value ) ) {
+      frame_limit = stoul( value );
+    } else if ( option_value( arg, "--window", value ) ) {
+      window = stof( value );
+    } else if ( arg == "--stdin" ) {
+      read_stdin = true;
+    } else if ( option_value( arg, "--series", value ) ) {
+      series = stoul( value );
+    } else if ( option_value( arg, "--write-trace", value ) ) {
+      write_trace = value;
+    } else if ( option_value( arg, "--replay", value ) ) {
+      replay = value;
+    } else if ( option_value( arg, "--speed", value ) ) {
+      speed = value == "max" ? 0 : stod( value );
+    } else if ( option_value( arg, "--seek", value ) ) {
+      seek_to = stof( value );
+      seeking = true;
+    } else if ( option_value( arg, "--overlay-threads", value ) ) {
+      overlay_threads = stoul( value );
+    } else if ( arg == "--latency" ) {
+      pacing = FrameScheduler::Mode::Latency;
+    } else if ( arg == "--idle" ) {
+      idle = true;
+    } else if ( arg == "--sdf-text" ) {
+      sdf_text = true;
+    } else if ( arg == "--hud" ) {
+      hud = true;
+    } else if ( option_value( arg, "--stats-csv", value ) ) {
+      stats_csv = value;
+    } else if ( option_value( arg, "--graphs", value ) ) {
+      graph_count = stoul( value );
+    } else if ( option_value( arg, "--record", value ) ) {
+      record = value;
+    } else if ( option_value( arg, "--record-format", value ) and (value == "y4m" or value == "rgb") ) {
+      record_format = value == "y4m" ? VideoWriter::Format::Y4M : VideoWriter::Format::RGB;
+    } else if ( option_value( arg, "--fps", value ) ) {
+      fps = stoul( value );
+    } else if ( option_value( arg, "--rate", value ) ) {
+      rate = stod( value );
+    } else if ( option_value( arg, "--antialiasing", value ) ) {
+      if ( not parse_antialiasing( value, antialiasing ) ) {
+	usage( argv[ 0 ] );
+      }
+    } else {
+      usage( argv[ 0 ] );
+    }
+  }
+
+  if ( window <= 0 or series == 0 or series > Display::max_batch_series or speed < 0 or overlay_threads == 0
+       or (read_stdin and not replay.empty()) or (not write_trace.empty() and not read_stdin)
+       or graph_count == 0 or (graph_count > 1 and (read_stdin or not replay.empty()))
+       or fps == 0 or (not record.empty() and idle) or rate < 0 or (rate > 0 and not read_stdin)
+       or (antialiasing == Display::Antialiasing::Analytic and line_mode_given
+	   and line_mode != Display::LineMode::Instanced) ) {
+    usage( argv[ 0 ] );
+  }
+
+  /* analytic antialiasing needs the segments expanded on the GPU */
+  if ( antialiasing == Display::Antialiasing::Analytic ) {
+    line_mode = Display::LineMode::Instanced;
+  }
+
+  /* recording draws into a framebuffer object, on a clock that advances a frame at a time */
+  const bool recording = not record.empty();
+  if ( recording ) {
+    offscreen = true;
+  }
+
+  /* a trace is opened first, so the graph can be sized for it */
+  unique_ptr<TraceFile> trace;
+  if ( not replay.empty() ) {
+    trace.reset( new TraceFile( replay ) );
+    if ( trace->series_count() == 0 ) {
+      throw runtime_error( replay + ": trace has no series" );
+    }
+  }
+
+  /* each series keeps the window (and a second of slack either side),
+     at the expected rate or the trace's densest */
+  size_t capacity = 65536;
+  if ( rate > 0 ) {
+    capacity = size_t( rate * (window + 2) ) + 2;
+  } else if ( trace ) {
+    capacity = max<size_t>( capacity, trace->densest( window + 2 ) + 2 );
+  }
+
+  /* every graph's window shares one context's programs, and they are drawn together */
+  Renderer renderer( offscreen, antialiasing );
+  for ( unsigned int i = 0; i < graph_count; i++ ) {
+    Graph & graph = graph_count == 1 ? renderer.add_graph( 1024, 768, "Ratatouille", capacity )
+      : renderer.add_graph( 640, 360, "Ratatouille " + to_string( i + 1 ) );
+    graph.set_line_mode( line_mode );
+    graph.set_overlay_threads( overlay_threads );
+    graph.set_idle( idle );
+    graph.set_sdf_text( sdf_text );
+  }
+
+  Graph & graph = renderer.graph( 0 );
+
+  /* the HUD only needs recent frames; the CSV needs them all */
+  Profiler profiler( stats_csv.empty() ? size_t( Graph::hud_frames ) : 0 );
+  if ( hud or not stats_csv.empty() ) {
+    graph.set_profiler( &profiler );
+    graph.set_hud( hud );
+  }
+
+  unique_ptr<VideoWriter> video;
+  if ( recording ) {
+    video.reset( new VideoWriter( record, record_format, fps ) );
+    graph.set_video_writer( video.get() );
+  }
+
+  FrameScheduler scheduler( recording ? FrameScheduler::Mode::Fixed : pacing,
+			    recording ? 1.0 / fps : renderer.refresh_interval() );
+
+  if ( read_stdin ) {
+    plot_stdin( graph, scheduler, series, write_trace, window, offscreen, frame_limit );
+  } else if ( not replay.empty() ) {
+    replay_trace( graph, scheduler, *trace, speed, seek_to, seeking, window, offscreen, frame_limit );
+  } else {
+    plot_random_walk( renderer, scheduler, window, frame_limit );
+  }
+
+  if ( recording ) {
+    graph.set_video_writer( nullptr );
+    video->finish();
+    cerr << video->frames_written() << " frames recorded to " << record << endl;
+  }
+
+  if ( not offscreen ) {
+    print_pacing( scheduler );
+  }
+
+  if ( not stats_csv.empty() ) {
+    profiler.write_csv( stats_csv );
+  }
 }
@@ -0,0 +1,55 @@
+#include <stdexcept>
+
+#include "options.hh"
+
+using namespace std;
+
+bool option_value( const string & arg, const string & name, string & value )
+{
+  const string prefix = name + "=";
+  if ( arg.compare( 0, prefix.size(), prefix ) != 0 ) {
+    return false;
+  }
+
+  value = arg.substr( prefix.size() );
+  return true;
+}
+
+bool parse_line_mode( const string & name, Display::LineMode & mode )
+{
+  if ( name == "immediate" ) {
+    mode = Display::LineMode::Immediate;
+  } else if ( name == "streaming" ) {
+    mode = Display::LineMode::Streaming;
+  } else if ( name == "instanced" ) {
+    mode = Display::LineMode::Instanced;
+  } else {
+    return false;
+  }
+
+  return true;
+}
+
+const char * line_mode_name( const Display::LineMode mode )
+{
+  switch ( mode ) {
+  case Display::LineMode::Immediate: return "immediate";
+  case Display::LineMode::Streaming: return "streaming";
+  case Display::LineMode::Instanced: return "instanced";
+  }
+
+  throw runtime_error( "unknown line mode" );
+}
+
+bool parse_antialiasing( const string & name, Display::Antialiasing & antialiasing )
+{
+  if ( name == "multisample" ) {
+    antialiasing = Display::Antialiasing::Multisample;
+  } else if ( name == "analytic" ) {
+    antialiasing = Display::Antialiasing::Analytic;
+  } else {
+    return false;
+  }
+
+  return true;
+}
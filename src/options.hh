@@ -0,0 +1,22 @@
+#ifndef OPTIONS_HH
+#define OPTIONS_HH
+
+#include <string>
+
+#include "display.hh"
+
+/* command-line parsing shared by glfun and glfun-bench */
+
+/* if arg is "name=value", put value in value */
+bool option_value( const std::string & arg, const std::string & name, std::string & value );
+
+/* "immediate", "streaming" or "instanced"; false (leaving mode alone) for anything else */
+bool parse_line_mode( const std::string & name, Display::LineMode & mode );
+
+/* the reverse, for reports */
+const char * line_mode_name( const Display::LineMode mode );
+
+/* "multisample" or "analytic"; false (leaving antialiasing alone) for anything else */
+bool parse_antialiasing( const std::string & name, Display::Antialiasing & antialiasing );
+
+#endif /* OPTIONS_HH */
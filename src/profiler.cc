@@ -0,0 +1,204 @@
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+#include <fstream>
+
+#include "profiler.hh"
+
+using namespace std;
+
+const char * Profiler::name( const Stage stage )
+{
+  switch ( stage ) {
+  case Overlay: return "overlay (Cairo)";
+  case Upload: return "texture upload";
+  case Geometry: return "line geometry";
+  case Submit: return "draw submission";
+  case Swap: return "swap";
+  case stage_count: break;
+  }
+
+  throw runtime_error( "unknown profiler stage" );
+}
+
+const char * Profiler::name( const GpuPass pass )
+{
+  switch ( pass ) {
+  case Layers: return "layers";
+  case Lines: return "lines";
+  case Text: return "text";
+  case Resolve: return "resolve";
+  case gpu_pass_count: break;
+  }
+
+  throw runtime_error( "unknown GPU pass" );
+}
+
+Profiler::Profiler( const size_t history )
+  : history_( history ),
+    first_frame_( 0 ),
+    current_(),
+    frames_(),
+    totals_(),
+    gpu_frames_(),
+    current_vertices_( 0 ),
+    current_uploaded_( 0 ),
+    vertices_(),
+    uploaded_()
+{
+  current_.fill( 0 );
+}
+
+template <class T>
+static void drop_front( vector<T> & values, const size_t count )
+{
+  values.erase( values.begin(), values.begin() + count );
+}
+
+void Profiler::end_frame( void )
+{
+  for ( unsigned int i = 0; i < stage_count; i++ ) {
+    frames_[ i ].push_back( current_[ i ] );
+  }
+
+  totals_.push_back( accumulate( current_.begin(), current_.end(), 0.0 ) );
+  current_.fill( 0 );
+
+  vertices_.push_back( current_vertices_ );
+  uploaded_.push_back( current_uploaded_ );
+  current_vertices_ = current_uploaded_ = 0;
+
+  for ( auto & x : gpu_frames_ ) {
+    x.resize( totals_.size(), -1 );
+  }
+
+  /* with a limited history, let it grow to twice that and then drop the
+     older half, so forgetting costs a constant time per frame */
+  if ( history_ and totals_.size() >= 2 * history_ ) {
+    const size_t forget = totals_.size() - history_;
+    for ( auto & x : frames_ ) {
+      drop_front( x, forget );
+    }
+    drop_front( totals_, forget );
+    for ( auto & x : gpu_frames_ ) {
+      drop_front( x, forget );
+    }
+    drop_front( vertices_, forget );
+    drop_front( uploaded_, forget );
+
+    first_frame_ += forget;
+  }
+}
+
+void Profiler::add_gpu( const uint64_t frame, const GpuPass pass, const double seconds )
+{
+  vector<double> & x = gpu_frames_.at( pass );
+  if ( frame < first_frame_ ) {
+    return; /* already forgotten */
+  }
+
+  const size_t index = frame - first_frame_;
+  if ( index >= x.size() ) {
+    x.resize( index + 1, -1 );
+  }
+
+  /* a pass may run more than once a frame */
+  x[ index ] = max( x[ index ], 0.0 ) + seconds;
+}
+
+void Profiler::count( const uint64_t vertices, const uint64_t uploaded_bytes )
+{
+  current_vertices_ += vertices;
+  current_uploaded_ += uploaded_bytes;
+}
+
+/* the last "last" values, or all of them if 0 */
+template <class T>
+static vector<T> recent( const vector<T> & values, const size_t last )
+{
+  const size_t first = (last == 0 or last > values.size()) ? 0 : values.size() - last;
+  return vector<T>( values.begin() + first, values.end() );
+}
+
+static double percentile_of( vector<double> values, const double p )
+{
+  if ( values.empty() ) {
+    return 0;
+  }
+
+  const size_t index = min( values.size() - 1, size_t( p * values.size() ) );
+  nth_element( values.begin(), values.begin() + index, values.end() );
+  return values[ index ];
+}
+
+template <class T>
+static double mean_of( const vector<T> & values )
+{
+  return values.empty() ? 0 : accumulate( values.begin(), values.end(), 0.0 ) / values.size();
+}
+
+double Profiler::percentile( const Stage stage, const double p, const size_t last ) const
+{
+  return percentile_of( recent( frames_.at( stage ), last ), p );
+}
+
+double Profiler::total_percentile( const double p, const size_t last ) const
+{
+  return percentile_of( recent( totals_, last ), p );
+}
+
+double Profiler::gpu_percentile( const GpuPass pass, const double p, const size_t last ) const
+{
+  vector<double> timed = recent( gpu_frames_.at( pass ), last );
+  timed.erase( remove_if( timed.begin(), timed.end(), [] ( const double x ) { return x < 0; } ), timed.end() );
+  return percentile_of( move( timed ), p );
+}
+
+double Profiler::mean_vertices( const size_t last ) const
+{
+  return mean_of( recent( vertices_, last ) );
+}
+
+double Profiler::mean_uploaded( const size_t last ) const
+{
+  return mean_of( recent( uploaded_, last ) );
+}
+
+void Profiler::write_csv( const string & filename ) const
+{
+  ofstream out( filename );
+  if ( not out ) {
+    throw runtime_error( "cannot create " + filename );
+  }
+
+  out << "frame";
+  for ( unsigned int i = 0; i < stage_count; i++ ) {
+    out << "," << name( static_cast<Stage>( i ) ) << " (ms)";
+  }
+  out << ",total (ms)";
+  for ( unsigned int i = 0; i < gpu_pass_count; i++ ) {
+    out << ",GPU " << name( static_cast<GpuPass>( i ) ) << " (ms)";
+  }
+  out << ",vertices,uploaded (bytes)\n";
+
+  for ( size_t frame = 0; frame < totals_.size(); frame++ ) {
+    out << first_frame_ + frame;
+    for ( const auto & x : frames_ ) {
+      out << "," << 1000 * x[ frame ];
+    }
+    out << "," << 1000 * totals_[ frame ];
+
+    /* frames whose GPU results never arrived are left blank */
+    for ( const auto & x : gpu_frames_ ) {
+      out << ",";
+      if ( x[ frame ] >= 0 ) {
+	out << 1000 * x[ frame ];
+      }
+    }
+    out << "," << vertices_[ frame ] << "," << uploaded_[ frame ] << "\n";
+  }
+
+  if ( not out.flush() ) {
+    throw runtime_error( "error writing " + filename );
+  }
+}
@@ -0,0 +1,108 @@
+#ifndef PROFILER_HH
+#define PROFILER_HH
+
+#include <vector>
+#include <array>
+#include <chrono>
+#include <string>
+#include <cstdint>
+
+/* per-frame wall-clock time spent in each stage of the render pipeline.
+   GL calls are asynchronous, so GL stages measure CPU-side submission
+   cost unless the driver blocks; the GPU's own time for each pass is
+   kept alongside, once it is known (a few frames later). */
+class Profiler
+{
+public:
+  enum Stage { Overlay, Upload, Geometry, Submit, Swap, stage_count };
+  enum GpuPass { Layers, Lines, Text, Resolve, gpu_pass_count };
+
+  static const char * name( const Stage stage );
+  static const char * name( const GpuPass pass );
+
+private:
+  /* frames kept (the most recent), or 0 to keep every one */
+  size_t history_;
+
+  /* the frame number of the oldest frame kept */
+  uint64_t first_frame_;
+
+  std::array<double, stage_count> current_;
+  std::array<std::vector<double>, stage_count> frames_;
+  std::vector<double> totals_;
+
+  /* by frame; negative until the GPU's results arrive (or if never timed) */
+  std::array<std::vector<double>, gpu_pass_count> gpu_frames_;
+
+  uint64_t current_vertices_, current_uploaded_;
+  std::vector<uint64_t> vertices_, uploaded_;
+
+public:
+  Profiler( const size_t history = 0 );
+
+  void add( const Stage stage, const double seconds ) { current_[ stage ] += seconds; }
+  void add_gpu( const uint64_t frame, const GpuPass pass, const double seconds );
+  void count( const uint64_t vertices, const uint64_t uploaded_bytes );
+  void end_frame( void );
+
+  /* frames ended, kept or not */
+  uint64_t frame_count( void ) const { return first_frame_ + totals_.size(); }
+
+  /* p in [0, 1]; seconds, over all frames kept or only the last ones */
+  double percentile( const Stage stage, const double p, const size_t last = 0 ) const;
+  double total_percentile( const double p, const size_t last = 0 ) const;
+
+  /* over the frames with results */
+  double gpu_percentile( const GpuPass pass, const double p, const size_t last = 0 ) const;
+
+  /* averages per frame */
+  double mean_vertices( const size_t last = 0 ) const;
+  double mean_uploaded( const size_t last = 0 ) const;
+
+  /* one row per frame kept, in milliseconds and bytes */
+  void write_csv( const std::string & filename ) const;
+};
+
+/* adds the time until destruction to a stage, if there is a profiler */
+class ScopedTimer
+{
+  Profiler * profiler_;
+  Profiler::Stage stage_;
+  std::chrono::steady_clock::time_point start_;
+
+  void charge( const std::chrono::steady_clock::time_point & now )
+  {
+    const std::chrono::duration<double> elapsed = now - start_;
+    profiler_->add( stage_, elapsed.count() );
+  }
+
+public:
+  ScopedTimer( Profiler * const profiler, const Profiler::Stage stage )
+    : profiler_( profiler ), stage_( stage ),
+      start_( profiler ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point() )
+  {}
+
+  ~ScopedTimer()
+  {
+    if ( profiler_ ) {
+      charge( std::chrono::steady_clock::now() );
+    }
+  }
+
+  /* charge the time so far, and keep timing under another stage */
+  void next( const Profiler::Stage stage )
+  {
+    if ( profiler_ ) {
+      const auto now = std::chrono::steady_clock::now();
+      charge( now );
+      start_ = now;
+    }
+    stage_ = stage;
+  }
+
+  /* forbid copy */
+  ScopedTimer( const ScopedTimer & other ) = delete;
+  ScopedTimer & operator=( const ScopedTimer & other ) = delete;
+};
+
+#endif /* PROFILER_HH */
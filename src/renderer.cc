@@ -0,0 +1,57 @@
+#include "renderer.hh"
+
+using namespace std;
+
+Renderer::Renderer( const bool offscreen, const Display::Antialiasing antialiasing )
+  : shared_(),
+    graphs_(),
+    offscreen_( offscreen ),
+    antialiasing_( antialiasing ),
+    drawn_(),
+    frames_drawn_( 0 )
+{}
+
+Graph & Renderer::add_graph( const unsigned int width, const unsigned int height, const string & title,
+			     const size_t data_capacity )
+{
+  graphs_.emplace_back( new Graph( &shared_, width, height, title, data_capacity, offscreen_, antialiasing_ ) );
+  return *graphs_.back();
+}
+
+bool Renderer::blocking_draw( const float t, const float logical_width )
+{
+  /* draw everything first... */
+  drawn_.clear();
+  for ( auto & graph : graphs_ ) {
+    if ( graph->render( t, logical_width ) ) {
+      drawn_.push_back( graph.get() );
+    }
+  }
+
+  frames_drawn_ = drawn_.size();
+
+  if ( drawn_.empty() ) {
+    Window::wait_events( Graph::idle_timeout );
+  } else {
+    /* ...then present it, with only the last swap waiting for the refresh */
+    for ( Graph * graph : drawn_ ) {
+      graph->set_swap_interval( (graph == drawn_.back() and not offscreen_) ? 1 : 0 );
+      graph->present();
+    }
+
+    glfwPollEvents();
+  }
+
+  for ( const auto & graph : graphs_ ) {
+    if ( graph->quit_requested() ) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+double Renderer::refresh_interval( void ) const
+{
+  return graphs_.empty() ? 0 : graphs_.front()->refresh_interval();
+}
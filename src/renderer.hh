@@ -0,0 +1,52 @@
+#ifndef RENDERER_HH
+#define RENDERER_HH
+
+#include <vector>
+#include <memory>
+#include <string>
+
+#include "graph.hh"
+
+/* many graph windows driven from one thread (the main one, as GLFW
+   requires): one owner of GLFW, windows whose contexts share a single
+   compiled set of shader programs, and a frame loop that draws every
+   graph before presenting any, so that only the last swap of a frame
+   waits for the display to refresh (instead of one wait per window) */
+class Renderer
+{
+  SharedContext shared_;
+  std::vector<std::unique_ptr<Graph>> graphs_;
+  bool offscreen_;
+  Display::Antialiasing antialiasing_;
+
+  std::vector<Graph *> drawn_;
+  size_t frames_drawn_;
+
+public:
+  Renderer( const bool offscreen = false,
+	    const Display::Antialiasing antialiasing = Display::Antialiasing::Multisample );
+
+  /* a new graph in its own window, valid as long as the renderer */
+  Graph & add_graph( const unsigned int width, const unsigned int height, const std::string & title,
+		     const size_t data_capacity = 65536 );
+
+  size_t graph_count( void ) const { return graphs_.size(); }
+  Graph & graph( const size_t index ) { return *graphs_.at( index ); }
+
+  /* draw every graph at the same time window and process events. when
+     none of them drew (all idle and unchanged), waits for an event
+     instead. returns true if the user asked to close any of them. */
+  bool blocking_draw( const float t, const float logical_width );
+
+  /* how many graphs drew in the last blocking_draw() */
+  size_t frames_drawn( void ) const { return frames_drawn_; }
+
+  /* seconds between refreshes of the display the graphs are paced by */
+  double refresh_interval( void ) const;
+
+  /* forbid copy */
+  Renderer( const Renderer & other ) = delete;
+  Renderer & operator=( const Renderer & other ) = delete;
+};
+
+#endif /* RENDERER_HH */
@@ -0,0 +1,111 @@
+#include <stdexcept>
+#include <algorithm>
+
+#include "sample_queue.hh"
+
+using namespace std;
+
+static size_t round_up_to_power_of_two( const size_t x )
+{
+  size_t ret = 1;
+  while ( ret < x ) {
+    ret *= 2;
+  }
+  return ret;
+}
+
+SampleQueue::SampleQueue( const size_t capacity )
+  : slots_( round_up_to_power_of_two( capacity ) ),
+    mask_( slots_.size() - 1 ),
+    notify_(),
+    before_producer_(),
+    head_( 0 ),
+    cached_tail_( 0 ),
+    dropped_( 0 ),
+    between_sides_(),
+    tail_( 0 ),
+    peak_occupancy_( 0 ),
+    after_consumer_()
+{
+  if ( capacity == 0 ) {
+    throw runtime_error( "SampleQueue capacity must be positive" );
+  }
+}
+
+bool SampleQueue::push( const float t, const float y )
+{
+  const uint64_t head = head_.load( memory_order_relaxed );
+
+  if ( head - cached_tail_ == slots_.size() ) {
+    /* looks full; see how far the consumer has got */
+    cached_tail_ = tail_.load( memory_order_acquire );
+
+    if ( head - cached_tail_ == slots_.size() ) {
+      dropped_.fetch_add( 1, memory_order_relaxed );
+      return false;
+    }
+  }
+
+  slots_[ head & mask_ ] = Sample( { t, y } );
+  head_.store( head + 1, memory_order_release );
+
+  if ( notify_ ) {
+    notify_();
+  }
+
+  return true;
+}
+
+size_t SampleQueue::push( const Sample * samples, const size_t count )
+{
+  const uint64_t head = head_.load( memory_order_relaxed );
+
+  if ( slots_.size() - (head - cached_tail_) < count ) {
+    cached_tail_ = tail_.load( memory_order_acquire );
+  }
+
+  const size_t accepted = min<size_t>( count, slots_.size() - (head - cached_tail_) );
+
+  for ( size_t i = 0; i < accepted; i++ ) {
+    slots_[ (head + i) & mask_ ] = samples[ i ];
+  }
+
+  if ( accepted ) {
+    head_.store( head + accepted, memory_order_release );
+
+    if ( notify_ ) {
+      notify_();
+    }
+  }
+
+  if ( accepted < count ) {
+    dropped_.fetch_add( count - accepted, memory_order_relaxed );
+  }
+
+  return accepted;
+}
+
+size_t SampleQueue::drain( vector<Sample> & out )
+{
+  const uint64_t tail = tail_.load( memory_order_relaxed );
+  const uint64_t head = head_.load( memory_order_acquire );
+  const size_t count = head - tail;
+
+  peak_occupancy_ = max( peak_occupancy_, count );
+
+  /* copy out at most two contiguous runs */
+  const size_t first = tail & mask_;
+  const size_t first_count = min( count, slots_.size() - first );
+  out.insert( out.end(), slots_.begin() + first, slots_.begin() + first + first_count );
+  out.insert( out.end(), slots_.begin(), slots_.begin() + (count - first_count) );
+
+  tail_.store( head, memory_order_release );
+  return count;
+}
+
+size_t SampleQueue::occupancy( void ) const
+{
+  const uint64_t tail = tail_.load( memory_order_acquire );
+  const uint64_t head = head_.load( memory_order_acquire );
+  return head - tail;
+}
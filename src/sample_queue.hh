@@ -0,0 +1,78 @@
+#ifndef SAMPLE_QUEUE_HH
+#define SAMPLE_QUEUE_HH
+
+#include <vector>
+#include <atomic>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+
+/* bounded single-producer, single-consumer queue of (time, value)
+   samples. push() is wait-free: when the queue is full the sample is
+   dropped and counted rather than blocking the producer. */
+
+class SampleQueue
+{
+public:
+  struct Sample
+  {
+    float t;
+    float y;
+  };
+
+private:
+  /* a cache line's worth of padding. (alignas( 64 ) would be neater, but
+     make_shared and new don't honor extended alignment in C++11, so the
+     fields are kept a whole line apart instead, wherever the queue starts.) */
+  static constexpr size_t cache_line = 64;
+
+  /* read by both sides, but written only before the producer starts */
+  std::vector<Sample> slots_;
+  size_t mask_;
+  std::function<void( void )> notify_;
+
+  char before_producer_[ cache_line ];
+
+  /* written by the producer */
+  std::atomic<uint64_t> head_;
+  uint64_t cached_tail_; /* producer's last view of tail_ */
+  std::atomic<uint64_t> dropped_;
+
+  char between_sides_[ cache_line ];
+
+  /* written by the consumer */
+  std::atomic<uint64_t> tail_;
+  size_t peak_occupancy_;
+
+  char after_consumer_[ cache_line ];
+
+public:
+  /* capacity is rounded up to a power of two */
+  SampleQueue( const size_t capacity );
+
+  /* called (on the producer's thread) after every push that adds
+     samples; set before the producer starts */
+  void set_notify( const std::function<void( void )> & notify ) { notify_ = notify; }
+
+  /* producer side */
+  bool push( const float t, const float y );
+
+  /* push as many as fit, publishing them together; returns how many (the rest are dropped) */
+  size_t push( const Sample * samples, const size_t count );
+
+  /* consumer side: append everything queued to out, returning the count */
+  size_t drain( std::vector<Sample> & out );
+
+  size_t capacity( void ) const { return slots_.size(); }
+  size_t occupancy( void ) const;
+  uint64_t dropped( void ) const { return dropped_.load( std::memory_order_relaxed ); }
+
+  /* highest occupancy seen by drain() */
+  size_t peak_occupancy( void ) const { return peak_occupancy_; }
+
+  /* forbid copy */
+  SampleQueue( const SampleQueue & other ) = delete;
+  SampleQueue & operator=( const SampleQueue & other ) = delete;
+};
+
+#endif /* SAMPLE_QUEUE_HH */
@@ -0,0 +1,84 @@
+#include <stdexcept>
+#include <algorithm>
+
+#include "sample_ring.hh"
+
+using namespace std;
+
+SampleRing::SampleRing( const size_t capacity )
+  : capacity_( capacity ),
+    times_( capacity ),
+    values_( capacity ),
+    head_( 0 ),
+    size_( 0 ),
+    pushed_( 0 )
+{
+  if ( capacity_ == 0 ) {
+    throw runtime_error( "SampleRing capacity must be positive" );
+  }
+}
+
+void SampleRing::push_back( const float t, const float y )
+{
+  if ( size_ == capacity_ ) {
+    pop_front();
+  }
+
+  const size_t index = physical_index( size_ );
+  times_[ index ] = t;
+  values_[ index ] = y;
+  size_++;
+  pushed_++;
+}
+
+void SampleRing::push_back( const float * times, const float * values, size_t count )
+{
+  /* only the last capacity samples can survive */
+  if ( count > capacity_ ) {
+    const size_t skipped = count - capacity_;
+    times += skipped;
+    values += skipped;
+    pushed_ += skipped;
+    count = capacity_;
+  }
+
+  /* overwrite the oldest samples as needed */
+  const size_t overwritten = size_ + count > capacity_ ? size_ + count - capacity_ : 0;
+  head_ = physical_index( overwritten );
+  size_ -= overwritten;
+
+  /* copy in at most two runs, split where the ring wraps */
+  const size_t first = physical_index( size_ );
+  const size_t first_count = min( count, capacity_ - first );
+  copy( times, times + first_count, times_.begin() + first );
+  copy( values, values + first_count, values_.begin() + first );
+  copy( times + first_count, times + count, times_.begin() );
+  copy( values + first_count, values + count, values_.begin() );
+
+  size_ += count;
+  pushed_ += count;
+}
+
+void SampleRing::pop_front( void )
+{
+  if ( size_ == 0 ) {
+    throw runtime_error( "pop_front on empty SampleRing" );
+  }
+
+  head_ = physical_index( 1 );
+  size_--;
+}
+
+void SampleRing::clear( void )
+{
+  head_ = 0;
+  size_ = 0;
+}
+
+pair<SampleRing::Span, SampleRing::Span> SampleRing::spans( void ) const
+{
+  const size_t first_length = min( size_, capacity_ - head_ );
+
+  return make_pair( Span( { &times_[ head_ ], &values_[ head_ ], head_, first_length } ),
+		    Span( { &times_[ 0 ], &values_[ 0 ], 0, size_ - first_length } ) );
+}
@@ -0,0 +1,65 @@
+#ifndef SAMPLE_RING_HH
+#define SAMPLE_RING_HH
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+
+/* fixed-capacity ring of (time, value) samples, stored as two
+   parallel arrays so that each can be read (or uploaded) contiguously */
+
+class SampleRing
+{
+  size_t capacity_;
+
+  std::vector<float> times_;
+  std::vector<float> values_;
+
+  size_t head_;   /* physical index of oldest sample */
+  size_t size_;
+  uint64_t pushed_; /* total samples ever pushed */
+
+public:
+  SampleRing( const size_t capacity );
+
+  /* a contiguous run of samples; offset is the physical index of the first one */
+  struct Span
+  {
+    const float * times;
+    const float * values;
+    size_t offset;
+    size_t length;
+  };
+
+  /* when full, the oldest sample is overwritten */
+  void push_back( const float t, const float y );
+
+  /* the same for many samples at once, copied a run at a time */
+  void push_back( const float * times, const float * values, size_t count );
+  void pop_front( void );
+  void clear( void );
+
+  bool empty( void ) const { return size_ == 0; }
+  size_t size( void ) const { return size_; }
+  size_t capacity( void ) const { return capacity_; }
+  uint64_t pushed( void ) const { return pushed_; }
+
+  size_t physical_index( const size_t logical_index ) const
+  {
+    const size_t index = head_ + logical_index;
+    return index < capacity_ ? index : index - capacity_;
+  }
+
+  float time( const size_t i ) const { return times_[ physical_index( i ) ]; }
+  float value( const size_t i ) const { return values_[ physical_index( i ) ]; }
+
+  float front_time( void ) const { return time( 0 ); }
+  float back_time( void ) const { return time( size_ - 1 ); }
+  float back_value( void ) const { return value( size_ - 1 ); }
+
+  /* the contents in order, as at most two contiguous spans (second may be empty) */
+  std::pair<Span, Span> spans( void ) const;
+};
+
+#endif /* SAMPLE_RING_HH */
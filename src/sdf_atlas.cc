@@ -0,0 +1,247 @@
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+
+#include "sdf_atlas.hh"
+
+using namespace std;
+
+/* coverage is rasterized this much finer than the atlas, for accurate distances */
+static const unsigned int supersample = 4;
+
+static const float far_away = 1e20;
+
+/* laid-out strings kept */
+static const size_t max_strings = 4096;
+
+/* squared distance from each of n elements to the nearest zero of f
+   (Felzenszwalb and Huttenlocher's lower envelope of parabolas) */
+static void squared_distances( const float * f, float * d, const size_t n,
+			       vector<size_t> & v, vector<float> & z )
+{
+  size_t k = 0;
+  v[ 0 ] = 0;
+  z[ 0 ] = -far_away;
+  z[ 1 ] = far_away;
+
+  auto intersection = [&] ( const size_t q, const size_t p ) {
+    return ((f[ q ] + float( q ) * q) - (f[ p ] + float( p ) * p)) / (2.0f * q - 2.0f * p);
+  };
+
+  for ( size_t q = 1; q < n; q++ ) {
+    float s = intersection( q, v[ k ] );
+    while ( s <= z[ k ] ) {
+      k--;
+      s = intersection( q, v[ k ] );
+    }
+    k++;
+    v[ k ] = q;
+    z[ k ] = s;
+    z[ k + 1 ] = far_away;
+  }
+
+  k = 0;
+  for ( size_t q = 0; q < n; q++ ) {
+    while ( z[ k + 1 ] < q ) {
+      k++;
+    }
+    const float offset = float( q ) - v[ k ];
+    d[ q ] = offset * offset + f[ v[ k ] ];
+  }
+}
+
+/* in place: zeros stay zero, everything else becomes its squared distance to the nearest zero */
+static void squared_distances_2d( vector<float> & grid, const size_t width, const size_t height )
+{
+  const size_t n = max( width, height );
+  vector<float> f( n ), d( n ), z( n + 1 );
+  vector<size_t> v( n );
+
+  for ( size_t x = 0; x < width; x++ ) {
+    for ( size_t y = 0; y < height; y++ ) {
+      f[ y ] = grid[ y * width + x ];
+    }
+    squared_distances( f.data(), d.data(), height, v, z );
+    for ( size_t y = 0; y < height; y++ ) {
+      grid[ y * width + x ] = d[ y ];
+    }
+  }
+
+  for ( size_t y = 0; y < height; y++ ) {
+    squared_distances( &grid[ y * width ], d.data(), width, v, z );
+    copy( d.begin(), d.begin() + width, grid.begin() + y * width );
+  }
+}
+
+SdfAtlas::SdfAtlas( const unsigned int size )
+  : size_( size ),
+    texels_( size_t( size ) * size ),
+    texture_( size, size, Texture::Format::Alpha ),
+    shelf_x_( 0 ),
+    shelf_y_( 0 ),
+    shelf_height_( 0 ),
+    cairo_( make_pair( 1, 1 ) ),
+    pango_( cairo_ ),
+    glyphs_(),
+    strings_()
+{
+  texture_.load( texels_.data(), size_, 0, 0, size_, size_ );
+}
+
+SdfAtlas::Glyph SdfAtlas::rasterize( const Pango::Font & font, const string & character )
+{
+  const Pango::Text text( cairo_, pango_, font, character );
+
+  /* the ink, in pixels from the layout's origin */
+  double x1, y1, x2, y2;
+  cairo_identity_matrix( cairo_ );
+  cairo_new_path( cairo_ );
+  cairo_append_path( cairo_, text );
+  cairo_fill_extents( cairo_, &x1, &y1, &x2, &y2 );
+  cairo_new_path( cairo_ );
+
+  if ( x2 <= x1 or y2 <= y1 ) {
+    /* nothing to draw (e.g. a space) */
+    return Glyph( { 0, 0, 0, 0, 0, 0 } );
+  }
+
+  const int left = int( floor( x1 ) ) - int( spread );
+  const int top = int( floor( y1 ) ) - int( spread );
+  const unsigned int width = int( ceil( x2 ) ) + spread - left;
+  const unsigned int height = int( ceil( y2 ) ) + spread - top;
+  const unsigned int texel_width = width * texels_per_pixel;
+  const unsigned int texel_height = height * texels_per_pixel;
+
+  /* find room on the current shelf, or start a new one */
+  if ( shelf_x_ + texel_width > size_ ) {
+    shelf_x_ = 0;
+    shelf_y_ += shelf_height_;
+    shelf_height_ = 0;
+  }
+
+  if ( texel_width > size_ or shelf_y_ + texel_height > size_ ) {
+    throw runtime_error( "SDF atlas full" );
+  }
+
+  const Glyph ret = { float( left ), float( top ), float( width ), float( height ), shelf_x_, shelf_y_ };
+  shelf_x_ += texel_width;
+  shelf_height_ = max( shelf_height_, texel_height );
+
+  /* rasterize the coverage finely */
+  const unsigned int scale = texels_per_pixel * supersample;
+  const size_t fine_width = texel_width * supersample, fine_height = texel_height * supersample;
+
+  Cairo coverage( make_pair( fine_width, fine_height ) );
+  coverage.mutable_image().clear_transparent();
+  cairo_scale( coverage, scale, scale );
+  cairo_translate( coverage, -left, -top );
+  cairo_append_path( coverage, text );
+  cairo_set_source_rgba( coverage, 0, 0, 0, 1 );
+  cairo_fill( coverage );
+  coverage.finish();
+
+  /* distances (in fine pixels) from outside to the nearest inside, and the reverse */
+  vector<float> to_inside( fine_width * fine_height ), to_outside( fine_width * fine_height );
+  vector<bool> inside( fine_width * fine_height );
+
+  for ( size_t y = 0; y < fine_height; y++ ) {
+    const Pixel * row = coverage.image().pixels() + y * coverage.image().stride_pixels();
+    for ( size_t x = 0; x < fine_width; x++ ) {
+      const size_t i = y * fine_width + x;
+      inside[ i ] = (row[ x ] >> 24) >= 128;
+      to_inside[ i ] = inside[ i ] ? 0 : far_away;
+      to_outside[ i ] = inside[ i ] ? far_away : 0;
+    }
+  }
+
+  squared_distances_2d( to_inside, fine_width, fine_height );
+  squared_distances_2d( to_outside, fine_width, fine_height );
+
+  /* each texel takes the mean signed distance of its fine pixels, with the outline
+     half a fine pixel past the last inside one */
+  const float range = 2.0f * spread * scale;
+
+  for ( unsigned int ty = 0; ty < texel_height; ty++ ) {
+    for ( unsigned int tx = 0; tx < texel_width; tx++ ) {
+      float total = 0;
+      for ( unsigned int sy = 0; sy < supersample; sy++ ) {
+	for ( unsigned int sx = 0; sx < supersample; sx++ ) {
+	  const size_t i = (ty * supersample + sy) * fine_width + tx * supersample + sx;
+	  total += inside[ i ] ? sqrt( to_outside[ i ] ) - 0.5f : 0.5f - sqrt( to_inside[ i ] );
+	}
+      }
+
+      const float value = 0.5f + total / (supersample * supersample) / range;
+      texels_[ size_t( ret.v + ty ) * size_ + ret.u + tx ] = lrintf( 255 * min( 1.0f, max( 0.0f, value ) ) );
+    }
+  }
+
+  texture_.load( texels_.data(), size_, ret.u, ret.v, texel_width, texel_height );
+
+  return ret;
+}
+
+const SdfAtlas::Glyph & SdfAtlas::glyph( const Pango::Font & font, const string & character )
+{
+  const auto key = make_pair( font.description, character );
+  auto it = glyphs_.find( key );
+  if ( it == glyphs_.end() ) {
+    it = glyphs_.emplace( key, rasterize( font, character ) ).first;
+  }
+  return it->second;
+}
+
+/* bytes in the UTF-8 sequence that starts with lead */
+static size_t utf8_length( const unsigned char lead )
+{
+  return lead < 0xC0 ? 1 : lead < 0xE0 ? 2 : lead < 0xF0 ? 3 : 4;
+}
+
+const vector<SdfAtlas::Quad> & SdfAtlas::layout( const Pango::Font & font, const string & text )
+{
+  const auto key = make_pair( font.description, text );
+  const auto found = strings_.find( key );
+  if ( found != strings_.end() ) {
+    return found->second;
+  }
+
+  /* glyphs are few, but strings (e.g. every second's tick label) are not */
+  if ( strings_.size() >= max_strings ) {
+    strings_.clear();
+  }
+
+  pango_.set_font( font );
+  pango_layout_set_text( pango_, text.data(), text.size() );
+
+  /* centered like Pango::Text, on the logical extents */
+  PangoRectangle logical;
+  pango_layout_get_extents( pango_, nullptr, &logical );
+  const float center_x = (logical.x + logical.width / 2.0) / PANGO_SCALE;
+  const float center_y = (logical.y + logical.height / 2.0) / PANGO_SCALE;
+
+  /* where each character starts (before rasterizing, which reuses the layout) */
+  vector<pair<string, float>> characters;
+  for ( size_t i = 0; i < text.size(); ) {
+    const size_t length = min( utf8_length( text[ i ] ), text.size() - i );
+
+    PangoRectangle position;
+    pango_layout_index_to_pos( pango_, i, &position );
+    characters.emplace_back( text.substr( i, length ), position.x / float( PANGO_SCALE ) );
+
+    i += length;
+  }
+
+  vector<Quad> quads;
+  for ( const auto & character : characters ) {
+    const Glyph & g = glyph( font, character.first );
+    if ( g.width == 0 ) {
+      continue;
+    }
+
+    quads.push_back( Quad( { character.second + g.x - center_x, g.y - center_y, g.width, g.height,
+			     float( g.u ), float( g.v ),
+			     g.width * texels_per_pixel, g.height * texels_per_pixel } ) );
+  }
+
+  return strings_.emplace( key, move( quads ) ).first->second;
+}
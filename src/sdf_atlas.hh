@@ -0,0 +1,68 @@
+#ifndef SDF_ATLAS_HH
+#define SDF_ATLAS_HH
+
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdint>
+
+#include "cairo_objects.hh"
+#include "gl_objects.hh"
+
+/* glyphs rasterized once, as signed distance fields, into a texture
+   that the GPU can draw text from at any scale or rotation. each texel
+   holds the distance to the glyph's outline, mapped so the outline is
+   0.5 and more is inside; linear filtering of that stays sharp where
+   filtering coverage would blur. */
+class SdfAtlas
+{
+public:
+  /* atlas texels per pixel at the font's own size, and how far (in
+     those pixels) outside and inside an outline distances are kept */
+  static constexpr unsigned int texels_per_pixel = 2;
+  static constexpr unsigned int spread = 4;
+
+  /* one glyph of a string, placed relative to the string's center */
+  struct Quad
+  {
+    float x, y, width, height;      /* pixels */
+    float u, v, u_width, v_height;  /* atlas texels */
+  };
+
+private:
+  struct Glyph
+  {
+    float x, y, width, height;      /* pixels from the character's layout origin */
+    unsigned int u, v;              /* atlas texels; the size is the pixel size times texels_per_pixel */
+  };
+
+  unsigned int size_;
+  std::vector<uint8_t> texels_;
+  Texture texture_;
+
+  /* shelf packing: glyphs fill rows left to right */
+  unsigned int shelf_x_, shelf_y_, shelf_height_;
+
+  Cairo cairo_;
+  Pango pango_;
+
+  /* keyed by font description and character (UTF-8), then text */
+  std::map<std::pair<std::string, std::string>, Glyph> glyphs_;
+  std::map<std::pair<std::string, std::string>, std::vector<Quad>> strings_;
+
+  const Glyph & glyph( const Pango::Font & font, const std::string & character );
+  Glyph rasterize( const Pango::Font & font, const std::string & character );
+
+public:
+  SdfAtlas( const unsigned int size = 1024 );
+
+  /* the glyphs of a string, laid out by Pango (once per font and text);
+     valid until the next call */
+  const std::vector<Quad> & layout( const Pango::Font & font, const std::string & text );
+
+  Texture & texture( void ) { return texture_; }
+
+  size_t glyph_count( void ) const { return glyphs_.size(); }
+};
+
+#endif /* SDF_ATLAS_HH */
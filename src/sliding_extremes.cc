@@ -0,0 +1,34 @@
+#include "sliding_extremes.hh"
+
+using namespace std;
+
+void SlidingExtremes::push( const uint64_t sequence_number, const float value )
+{
+  /* an older sample can never be the extreme once a newer, more extreme one arrives */
+  while ( (not maxima_.empty()) and (maxima_.back().second <= value) ) {
+    maxima_.pop_back();
+  }
+  maxima_.emplace_back( sequence_number, value );
+
+  while ( (not minima_.empty()) and (minima_.back().second >= value) ) {
+    minima_.pop_back();
+  }
+  minima_.emplace_back( sequence_number, value );
+}
+
+void SlidingExtremes::expire( const uint64_t first_live )
+{
+  while ( (not maxima_.empty()) and (maxima_.front().first < first_live) ) {
+    maxima_.pop_front();
+  }
+
+  while ( (not minima_.empty()) and (minima_.front().first < first_live) ) {
+    minima_.pop_front();
+  }
+}
+
+void SlidingExtremes::clear( void )
+{
+  maxima_.clear();
+  minima_.clear();
+}
@@ -0,0 +1,32 @@
+#ifndef SLIDING_EXTREMES_HH
+#define SLIDING_EXTREMES_HH
+
+#include <deque>
+#include <cstdint>
+#include <utility>
+
+/* running minimum and maximum of a sliding window of samples,
+   kept as two monotonic deques of (sequence number, value) so that
+   each push and expiry costs amortized O(1) */
+
+class SlidingExtremes
+{
+  std::deque<std::pair<uint64_t, float>> maxima_; /* values strictly decreasing */
+  std::deque<std::pair<uint64_t, float>> minima_; /* values strictly increasing */
+
+public:
+  SlidingExtremes() : maxima_(), minima_() {}
+
+  void push( const uint64_t sequence_number, const float value );
+
+  /* forget every sample with a sequence number below first_live */
+  void expire( const uint64_t first_live );
+
+  void clear( void );
+
+  bool empty( void ) const { return maxima_.empty(); }
+  float max( void ) const { return maxima_.front().second; }
+  float min( void ) const { return minima_.front().second; }
+};
+
+#endif /* SLIDING_EXTREMES_HH */
@@ -0,0 +1,349 @@
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <algorithm>
+#include <stdexcept>
+
+#include <unistd.h>
+#include <poll.h>
+
+#include "text_stream.hh"
+
+using namespace std;
+
+/* doubles up to 2^53 times or divided by these are correctly rounded */
+static const double powers_of_ten[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+					1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+static const int max_mantissa_digits = 19;
+
+static bool is_digit( const char c )
+{
+  return c >= '0' and c <= '9';
+}
+
+/* if the next eight characters are all digits, put their value in value (SWAR) */
+static bool eight_digits( const char * const cursor, uint64_t & value )
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  uint64_t chunk;
+  memcpy( &chunk, cursor, sizeof( chunk ) );
+
+  if ( ((chunk & 0xF0F0F0F0F0F0F0F0) | (((chunk + 0x0606060606060606) & 0xF0F0F0F0F0F0F0F0) >> 4))
+       != 0x3333333333333333 ) {
+    return false;
+  }
+
+  /* combine adjacent digits into pairs, then pairs into fours, then the two fours */
+  chunk -= 0x3030303030303030;
+  chunk = (chunk * 10) + (chunk >> 8);
+  chunk = (((chunk & 0x000000FF000000FF) * (100 + (1000000ULL << 32)))
+	   + (((chunk >> 16) & 0x000000FF000000FF) * (1 + (10000ULL << 32)))) >> 32;
+
+  value = static_cast<uint32_t>( chunk );
+  return true;
+#else
+  (void) cursor;
+  (void) value;
+  return false;
+#endif
+}
+
+/* accumulate a run of digits into mantissa, counting how many were taken */
+static const char * accumulate_digits( const char * cursor, const char * const end,
+				       uint64_t & mantissa, int & digits, bool & too_long )
+{
+  uint64_t eight;
+  while ( end - cursor >= 8 and digits + 8 <= max_mantissa_digits and eight_digits( cursor, eight ) ) {
+    mantissa = mantissa * 100000000 + eight;
+    digits += 8;
+    cursor += 8;
+  }
+
+  while ( cursor < end and is_digit( *cursor ) ) {
+    if ( digits < max_mantissa_digits ) {
+      mantissa = mantissa * 10 + (*cursor - '0');
+      digits++;
+    } else {
+      too_long = true;
+    }
+    cursor++;
+  }
+
+  return cursor;
+}
+
+bool NumberParser::parse_float( const char * & cursor, const char * const end, float & out )
+{
+  const char * p = cursor;
+
+  bool negative = false;
+  if ( p < end and (*p == '-' or *p == '+') ) {
+    negative = *p == '-';
+    p++;
+  }
+
+  uint64_t mantissa = 0;
+  int digits = 0;
+  int exponent = 0;
+  bool too_long = false;
+
+  const char * const integer_start = p;
+  p = accumulate_digits( p, end, mantissa, digits, too_long );
+  bool any_digits = p != integer_start;
+
+  if ( p < end and *p == '.' ) {
+    p++;
+    const char * const fraction_start = p;
+    const int integer_digits = digits;
+    p = accumulate_digits( p, end, mantissa, digits, too_long );
+    exponent -= digits - integer_digits;
+    any_digits = any_digits or p != fraction_start;
+  }
+
+  if ( not any_digits ) {
+    return false;
+  }
+
+  if ( p < end and (*p == 'e' or *p == 'E') ) {
+    const char * q = p + 1;
+    bool negative_exponent = false;
+    if ( q < end and (*q == '-' or *q == '+') ) {
+      negative_exponent = *q == '-';
+      q++;
+    }
+
+    if ( q < end and is_digit( *q ) ) {
+      int written_exponent = 0;
+      while ( q < end and is_digit( *q ) ) {
+	written_exponent = min( written_exponent * 10 + (*q - '0'), 100000 );
+	q++;
+      }
+      exponent += negative_exponent ? -written_exponent : written_exponent;
+      p = q;
+    }
+  }
+
+  if ( (not too_long) and mantissa <= (uint64_t( 1 ) << 53) and exponent >= -22 and exponent <= 22 ) {
+    double value = mantissa;
+    value = exponent < 0 ? value / powers_of_ten[ -exponent ] : value * powers_of_ten[ exponent ];
+    out = negative ? -value : value;
+  } else {
+    /* rare: too many digits, or a large exponent */
+    char token[ 128 ];
+    const size_t length = p - cursor;
+    if ( length >= sizeof( token ) ) {
+      return false;
+    }
+    memcpy( token, cursor, length );
+    token[ length ] = 0;
+    out = strtof( token, nullptr );
+  }
+
+  cursor = p;
+  return true;
+}
+
+bool NumberParser::parse_unsigned( const char * & cursor, const char * const end, size_t & out )
+{
+  const char * p = cursor;
+  size_t value = 0;
+
+  while ( p < end and is_digit( *p ) and p - cursor < max_mantissa_digits ) {
+    value = value * 10 + (*p - '0');
+    p++;
+  }
+
+  if ( p == cursor or (p < end and is_digit( *p )) ) {
+    return false;
+  }
+
+  out = value;
+  cursor = p;
+  return true;
+}
+
+static bool is_blank( const char c )
+{
+  return c == ' ' or c == '\t' or c == '\r';
+}
+
+static const char * skip_blanks( const char * cursor, const char * const end )
+{
+  while ( cursor < end and is_blank( *cursor ) ) {
+    cursor++;
+  }
+  return cursor;
+}
+
+TextStreamReader::TextStreamReader( const int fd, const vector<shared_ptr<SampleQueue>> & queues,
+				    TraceWriter * const recording )
+  : fd_( fd ),
+    queues_( queues ),
+    recording_( recording ),
+    stop_( false ),
+    finished_( false ),
+    bytes_( 0 ),
+    lines_( 0 ),
+    rejected_( 0 ),
+    latest_time_( 0 ),
+    finish_seconds_( 0 ),
+    start_( chrono::steady_clock::now() ),
+    thread_( &TextStreamReader::loop, this )
+{}
+
+TextStreamReader::~TextStreamReader()
+{
+  stop();
+}
+
+void TextStreamReader::stop( void )
+{
+  stop_ = true;
+  if ( thread_.joinable() ) {
+    thread_.join();
+  }
+}
+
+TextStreamReader::Statistics TextStreamReader::statistics( void ) const
+{
+  const bool finished = finished_.load( memory_order_acquire );
+  const chrono::duration<double> elapsed = chrono::steady_clock::now() - start_;
+
+  return Statistics( { bytes_.load(), lines_.load(), rejected_.load(),
+		       finished ? finish_seconds_.load() : elapsed.count(), finished } );
+}
+
+/* reads are this large; a line may be at most max_line_length long */
+static const size_t block_size = 1 << 20;
+static const size_t max_line_length = 4096;
+
+/* samples are handed to a queue in batches of (at most) this many */
+static const size_t batch_size = 4096;
+
+void TextStreamReader::loop( void )
+{
+  vector<char> buffer( max_line_length + block_size );
+  size_t carried = 0; /* start of a line left over from the last block */
+
+  vector<vector<SampleQueue::Sample>> batches( queues_.size() );
+  for ( auto & batch : batches ) {
+    batch.reserve( batch_size );
+  }
+
+  uint64_t lines = 0, rejected = 0;
+  float latest_time = latest_time_.load();
+
+  auto flush = [&] ( const size_t series ) {
+    queues_[ series ]->push( batches[ series ].data(), batches[ series ].size() );
+    batches[ series ].clear();
+  };
+
+  auto parse_line = [&] ( const char * p, const char * const end ) {
+    p = skip_blanks( p, end );
+    if ( p == end or *p == '#' ) {
+      return;
+    }
+
+    float t, y;
+    size_t series = 0;
+
+    if ( not NumberParser::parse_float( p, end, t ) or p == end or not is_blank( *p ) ) {
+      rejected++;
+      return;
+    }
+
+    p = skip_blanks( p, end );
+    if ( not NumberParser::parse_float( p, end, y ) or (p < end and not is_blank( *p )) ) {
+      rejected++;
+      return;
+    }
+
+    p = skip_blanks( p, end );
+    if ( p < end and not NumberParser::parse_unsigned( p, end, series ) ) {
+      rejected++;
+      return;
+    }
+
+    if ( skip_blanks( p, end ) != end or series >= queues_.size() ) {
+      rejected++;
+      return;
+    }
+
+    if ( recording_ ) {
+      recording_->add( series, t, y );
+    }
+
+    batches[ series ].push_back( SampleQueue::Sample( { t, y } ) );
+    if ( batches[ series ].size() == batch_size ) {
+      flush( series );
+    }
+
+    latest_time = max( latest_time, t );
+    lines++;
+  };
+
+  bool end_of_input = false;
+  bool discarding = false;
+
+  while ( not end_of_input and not stop_ ) {
+    /* wake up now and then to see if we should stop */
+    pollfd waiting = { fd_, POLLIN, 0 };
+    const int ready = poll( &waiting, 1, 100 );
+    if ( ready == 0 or (ready < 0 and errno == EINTR) ) {
+      continue;
+    }
+
+    const ssize_t bytes_read = ready < 0 ? -1 : read( fd_, buffer.data() + carried, block_size );
+    if ( bytes_read < 0 and errno == EINTR ) {
+      continue;
+    }
+
+    const char * p = buffer.data();
+    const char * const end = buffer.data() + carried + max<ssize_t>( bytes_read, 0 );
+
+    /* drop the rest of an overlong line */
+    if ( discarding ) {
+      const char * newline = static_cast<const char *>( memchr( p, '\n', end - p ) );
+      p = newline ? newline + 1 : end;
+      discarding = not newline;
+    }
+
+    /* split into lines (memchr is vectorized) */
+    while ( const char * newline = static_cast<const char *>( memchr( p, '\n', end - p ) ) ) {
+      parse_line( p, newline );
+      p = newline + 1;
+    }
+
+    if ( bytes_read <= 0 ) {
+      /* end of input (or an error, which ends it too); take a last line with no newline */
+      parse_line( p, end );
+      p = end;
+      end_of_input = true;
+    }
+
+    carried = end - p;
+    if ( carried > max_line_length ) {
+      rejected++;
+      carried = 0;
+      discarding = true;
+    } else {
+      memmove( buffer.data(), p, carried );
+    }
+
+    for ( size_t series = 0; series < batches.size(); series++ ) {
+      if ( not batches[ series ].empty() ) {
+	flush( series );
+      }
+    }
+
+    bytes_ += max<ssize_t>( bytes_read, 0 );
+    lines_ = lines;
+    rejected_ = rejected;
+    latest_time_.store( latest_time, memory_order_relaxed );
+  }
+
+  const chrono::duration<double> elapsed = chrono::steady_clock::now() - start_;
+  finish_seconds_ = elapsed.count();
+  finished_.store( end_of_input, memory_order_release );
+}
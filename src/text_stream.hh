@@ -0,0 +1,86 @@
+#ifndef TEXT_STREAM_HH
+#define TEXT_STREAM_HH
+
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <cstdint>
+
+#include "sample_queue.hh"
+#include "trace_file.hh"
+
+/* parsing of plain decimal numbers without iostreams, locales or
+   allocation. each function advances the cursor past what it read and
+   returns false (leaving the cursor alone) if there is no number there. */
+class NumberParser
+{
+public:
+  NumberParser() = delete;
+
+  /* [+-]digits[.digits][(e|E)[+-]digits], or a leading "." */
+  static bool parse_float( const char * & cursor, const char * const end, float & out );
+
+  static bool parse_unsigned( const char * & cursor, const char * const end, size_t & out );
+};
+
+/* reads "t y [series]" lines from a file descriptor in large blocks on
+   its own thread, and pushes the samples into one queue per series.
+   lines that don't parse, or name a series with no queue, are counted
+   and skipped; blank lines and lines starting with # are ignored.
+   optionally, every sample is also recorded to a trace. */
+class TextStreamReader
+{
+public:
+  struct Statistics
+  {
+    uint64_t bytes;
+    uint64_t lines;    /* samples parsed */
+    uint64_t rejected; /* lines that didn't parse */
+    double seconds;    /* since the reader started, until end of input */
+    bool finished;
+  };
+
+private:
+  int fd_;
+  std::vector<std::shared_ptr<SampleQueue>> queues_;
+  TraceWriter * recording_; /* used only on the reader's thread */
+
+  std::atomic<bool> stop_;
+  std::atomic<bool> finished_;
+
+  std::atomic<uint64_t> bytes_;
+  std::atomic<uint64_t> lines_;
+  std::atomic<uint64_t> rejected_;
+  std::atomic<float> latest_time_;
+  std::atomic<double> finish_seconds_;
+
+  std::chrono::steady_clock::time_point start_;
+
+  std::thread thread_;
+
+  void loop( void );
+
+public:
+  TextStreamReader( const int fd, const std::vector<std::shared_ptr<SampleQueue>> & queues,
+		    TraceWriter * const recording = nullptr );
+  ~TextStreamReader();
+
+  /* stop reading and wait for the thread to exit */
+  void stop( void );
+
+  /* the greatest time read so far */
+  float latest_time( void ) const { return latest_time_.load( std::memory_order_relaxed ); }
+
+  /* end of input was reached and everything read has been queued */
+  bool finished( void ) const { return finished_.load( std::memory_order_acquire ); }
+
+  Statistics statistics( void ) const;
+
+  /* forbid copy */
+  TextStreamReader( const TextStreamReader & other ) = delete;
+  TextStreamReader & operator=( const TextStreamReader & other ) = delete;
+};
+
+#endif /* TEXT_STREAM_HH */
@@ -0,0 +1,376 @@
+#include <cstring>
+#include <cerrno>
+#include <limits>
+#include <algorithm>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "trace_file.hh"
+
+using namespace std;
+
+struct TraceHeader
+{
+  char magic[ 8 ];
+  uint32_t version;
+  uint32_t byte_order; /* trace_byte_order as written */
+  uint64_t series_count;
+  uint64_t index_offset;
+};
+
+static const char trace_magic[ 8 ] = { 'g', 'l', 'f', 'u', 'n', 't', 'r', 'c' };
+static const uint32_t trace_version = 1;
+static const uint32_t trace_byte_order = 0x01020304;
+
+static runtime_error file_error( const string & what, const string & filename )
+{
+  return runtime_error( what + " " + filename + ": " + strerror( errno ) );
+}
+
+TraceWriter::TraceWriter( const string & filename, const size_t series_count )
+  : fd_( open( filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644 ) ),
+    offset_( 0 ),
+    pending_times_( series_count ),
+    pending_values_( series_count ),
+    index_( series_count ),
+    last_times_( series_count, -numeric_limits<float>::infinity() ),
+    out_of_order_( 0 ),
+    finished_( false )
+{
+  if ( fd_ < 0 ) {
+    throw file_error( "cannot create", filename );
+  }
+
+  /* the header is filled in by finish() */
+  const TraceHeader header = {};
+  write_all( &header, sizeof( header ) );
+}
+
+TraceWriter::~TraceWriter()
+{
+  close( fd_ );
+}
+
+void TraceWriter::write_all( const void * data, const size_t length )
+{
+  const char * p = static_cast<const char *>( data );
+  size_t remaining = length;
+
+  while ( remaining ) {
+    const ssize_t written = write( fd_, p, remaining );
+    if ( written < 0 ) {
+      if ( errno == EINTR ) {
+	continue;
+      }
+      throw runtime_error( string( "trace write: " ) + strerror( errno ) );
+    }
+    p += written;
+    remaining -= written;
+  }
+
+  offset_ += length;
+}
+
+void TraceWriter::write_block( const size_t series )
+{
+  vector<float> & times = pending_times_[ series ];
+  vector<float> & values = pending_values_[ series ];
+
+  index_[ series ].push_back( IndexEntry( { offset_, uint32_t( times.size() ),
+					    times.front(), times.back(), 0 } ) );
+
+  write_all( times.data(), times.size() * sizeof( float ) );
+  write_all( values.data(), values.size() * sizeof( float ) );
+
+  times.clear();
+  values.clear();
+}
+
+bool TraceWriter::add( const size_t series, const float t, const float y )
+{
+  if ( finished_ ) {
+    throw runtime_error( "TraceWriter: add after finish" );
+  }
+
+  if ( not (t >= last_times_.at( series )) ) {
+    out_of_order_++;
+    return false;
+  }
+  last_times_[ series ] = t;
+
+  pending_times_[ series ].push_back( t );
+  pending_values_[ series ].push_back( y );
+
+  if ( pending_times_[ series ].size() == block_capacity ) {
+    write_block( series );
+  }
+
+  return true;
+}
+
+void TraceWriter::finish( void )
+{
+  if ( finished_ ) {
+    return;
+  }
+
+  for ( size_t series = 0; series < pending_times_.size(); series++ ) {
+    if ( not pending_times_[ series ].empty() ) {
+      write_block( series );
+    }
+  }
+
+  TraceHeader header = {};
+  memcpy( header.magic, trace_magic, sizeof( header.magic ) );
+  header.version = trace_version;
+  header.byte_order = trace_byte_order;
+  header.series_count = index_.size();
+  header.index_offset = offset_;
+
+  for ( const auto & blocks : index_ ) {
+    const uint64_t count = blocks.size();
+    write_all( &count, sizeof( count ) );
+    write_all( blocks.data(), blocks.size() * sizeof( IndexEntry ) );
+  }
+
+  if ( pwrite( fd_, &header, sizeof( header ), 0 ) != sizeof( header ) ) {
+    throw runtime_error( string( "trace header write: " ) + strerror( errno ) );
+  }
+
+  finished_ = true;
+}
+
+/* the index as stored (see TraceWriter) */
+struct TraceIndexEntry
+{
+  uint64_t offset;
+  uint32_t count;
+  float first_time;
+  float last_time;
+  uint32_t reserved;
+};
+
+TraceFile::TraceFile( const string & filename )
+  : fd_( open( filename.c_str(), O_RDONLY ) ),
+    length_( 0 ),
+    data_( nullptr ),
+    series_()
+{
+  if ( fd_ < 0 ) {
+    throw file_error( "cannot open", filename );
+  }
+
+  try {
+    struct stat info;
+    if ( fstat( fd_, &info ) < 0 ) {
+      throw file_error( "cannot stat", filename );
+    }
+    length_ = info.st_size;
+
+    if ( length_ < sizeof( TraceHeader ) ) {
+      throw runtime_error( filename + ": not a glfun trace" );
+    }
+
+    void * mapping = mmap( nullptr, length_, PROT_READ, MAP_PRIVATE, fd_, 0 );
+    if ( mapping == MAP_FAILED ) {
+      throw file_error( "cannot map", filename );
+    }
+    data_ = static_cast<const char *>( mapping );
+    madvise( mapping, length_, MADV_SEQUENTIAL );
+
+    TraceHeader header;
+    memcpy( &header, data_, sizeof( header ) );
+
+    if ( memcmp( header.magic, trace_magic, sizeof( trace_magic ) ) != 0 ) {
+      throw runtime_error( filename + ": not a glfun trace (or not finished)" );
+    }
+
+    if ( header.version != trace_version or header.byte_order != trace_byte_order ) {
+      throw runtime_error( filename + ": unsupported trace version or byte order" );
+    }
+
+    /* read the index, checking everything it points to is inside the blocks */
+    uint64_t position = header.index_offset;
+    const auto corrupt = [&] () { return runtime_error( filename + ": corrupt trace index" ); };
+
+    if ( position > length_ ) {
+      throw corrupt();
+    }
+
+    for ( uint64_t series = 0; series < header.series_count; series++ ) {
+      uint64_t count;
+      if ( length_ - position < sizeof( count ) ) {
+	throw corrupt();
+      }
+      memcpy( &count, data_ + position, sizeof( count ) );
+      position += sizeof( count );
+
+      if ( count > (length_ - position) / sizeof( TraceIndexEntry ) ) {
+	throw corrupt();
+      }
+
+      series_.emplace_back();
+      series_.back().reserve( count );
+
+      for ( uint64_t i = 0; i < count; i++ ) {
+	TraceIndexEntry entry;
+	memcpy( &entry, data_ + position, sizeof( entry ) );
+	position += sizeof( entry );
+
+	if ( entry.count == 0 or entry.offset % sizeof( float )
+	     or entry.offset > header.index_offset
+	     or (header.index_offset - entry.offset) / (2 * sizeof( float )) < entry.count ) {
+	  throw corrupt();
+	}
+
+	const float * times = reinterpret_cast<const float *>( data_ + entry.offset );
+	series_.back().push_back( Block( { times, times + entry.count, entry.count,
+					   entry.first_time, entry.last_time } ) );
+      }
+    }
+  } catch ( ... ) {
+    if ( data_ ) {
+      munmap( const_cast<char *>( data_ ), length_ );
+    }
+    close( fd_ );
+    throw;
+  }
+}
+
+TraceFile::~TraceFile()
+{
+  munmap( const_cast<char *>( data_ ), length_ );
+  close( fd_ );
+}
+
+float TraceFile::start_time( void ) const
+{
+  float ret = numeric_limits<float>::max();
+  for ( const auto & blocks : series_ ) {
+    if ( not blocks.empty() ) {
+      ret = min( ret, blocks.front().first_time );
+    }
+  }
+  return ret == numeric_limits<float>::max() ? 0 : ret;
+}
+
+float TraceFile::end_time( void ) const
+{
+  float ret = numeric_limits<float>::lowest();
+  for ( const auto & blocks : series_ ) {
+    if ( not blocks.empty() ) {
+      ret = max( ret, blocks.back().last_time );
+    }
+  }
+  return ret == numeric_limits<float>::lowest() ? 0 : ret;
+}
+
+uint64_t TraceFile::sample_count( void ) const
+{
+  uint64_t ret = 0;
+  for ( const auto & blocks : series_ ) {
+    for ( const auto & block : blocks ) {
+      ret += block.count;
+    }
+  }
+  return ret;
+}
+
+uint64_t TraceFile::densest( const double duration ) const
+{
+  uint64_t ret = 0;
+  for ( const auto & blocks : series_ ) {
+    /* a span whose first block is i ends before the last time of i, plus
+       duration; count every block starting by then */
+    size_t end = 0;
+    uint64_t count = 0;
+    for ( size_t i = 0; i < blocks.size(); i++ ) {
+      while ( end < blocks.size() and blocks[ end ].first_time <= blocks[ i ].last_time + duration ) {
+	count += blocks[ end ].count;
+	end++;
+      }
+      ret = max( ret, count );
+      count -= blocks[ i ].count;
+    }
+  }
+  return ret;
+}
+
+TraceReplay::TraceReplay( const TraceFile & trace )
+  : trace_( trace ),
+    positions_( trace.series_count(), Position( { 0, 0 } ) ),
+    replayed_( 0 )
+{}
+
+void TraceReplay::seek( const float t )
+{
+  for ( size_t series = 0; series < positions_.size(); series++ ) {
+    const auto & blocks = trace_.blocks( series );
+
+    /* the first block that ends at or after t, then the first sample in it at or after t */
+    const auto block = lower_bound( blocks.begin(), blocks.end(), t,
+				    [] ( const TraceFile::Block & b, const float x ) { return b.last_time < x; } );
+
+    if ( block == blocks.end() ) {
+      positions_[ series ] = Position( { blocks.size(), 0 } );
+    } else {
+      const float * sample = lower_bound( block->times, block->times + block->count, t );
+      positions_[ series ] = Position( { size_t( block - blocks.begin() ), size_t( sample - block->times ) } );
+    }
+  }
+}
+
+void TraceReplay::advance( const float t, Graph & graph )
+{
+  for ( size_t series = 0; series < positions_.size(); series++ ) {
+    const auto & blocks = trace_.blocks( series );
+    Position & position = positions_[ series ];
+
+    while ( position.block < blocks.size() ) {
+      const TraceFile::Block & block = blocks[ position.block ];
+
+      const size_t end = block.last_time <= t
+	? block.count
+	: upper_bound( block.times + position.index, block.times + block.count, t ) - block.times;
+
+      if ( end > position.index ) {
+	graph.add_data_points( series, block.times + position.index, block.values + position.index,
+			       end - position.index );
+	replayed_ += end - position.index;
+      }
+
+      if ( end < block.count ) {
+	position.index = end;
+	break;
+      }
+
+      position = Position( { position.block + 1, 0 } );
+    }
+  }
+}
+
+float TraceReplay::next_block_end( void ) const
+{
+  float ret = numeric_limits<float>::max();
+  for ( size_t series = 0; series < positions_.size(); series++ ) {
+    const auto & blocks = trace_.blocks( series );
+    if ( positions_[ series ].block < blocks.size() ) {
+      ret = min( ret, blocks[ positions_[ series ].block ].last_time );
+    }
+  }
+  return ret == numeric_limits<float>::max() ? trace_.end_time() : ret;
+}
+
+bool TraceReplay::finished( void ) const
+{
+  for ( size_t series = 0; series < positions_.size(); series++ ) {
+    if ( positions_[ series ].block < trace_.blocks( series ).size() ) {
+      return false;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,139 @@
+#ifndef TRACE_FILE_HH
+#define TRACE_FILE_HH
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "graph.hh"
+
+/* a glfun trace holds one or more series of (time, value) samples.
+   after a header come blocks of up to TraceWriter::block_capacity
+   samples of a single series, each block all of its times followed
+   by all of its values (native floats). the file ends with an index
+   giving, for each series in order, the offset, count and time range
+   of each of its blocks. */
+
+class TraceWriter
+{
+public:
+  static constexpr uint32_t block_capacity = 4096;
+
+private:
+  struct IndexEntry
+  {
+    uint64_t offset;
+    uint32_t count;
+    float first_time;
+    float last_time;
+    uint32_t reserved;
+  };
+
+  int fd_;
+  uint64_t offset_;
+
+  /* samples not yet written, and the blocks that have been, per series */
+  std::vector<std::vector<float>> pending_times_;
+  std::vector<std::vector<float>> pending_values_;
+  std::vector<std::vector<IndexEntry>> index_;
+
+  /* each series' latest time, and the samples left out for going back before it */
+  std::vector<float> last_times_;
+  uint64_t out_of_order_;
+
+  bool finished_;
+
+  void write_all( const void * data, const size_t length );
+  void write_block( const size_t series );
+
+public:
+  TraceWriter( const std::string & filename, const size_t series_count );
+  ~TraceWriter();
+
+  /* samples of each series must come in time order (which the reader's
+     seek relies on); one that goes back in time is left out, and add()
+     returns false */
+  bool add( const size_t series, const float t, const float y );
+
+  uint64_t out_of_order( void ) const { return out_of_order_; }
+
+  /* write out the remaining samples and the index */
+  void finish( void );
+
+  /* forbid copy */
+  TraceWriter( const TraceWriter & other ) = delete;
+  TraceWriter & operator=( const TraceWriter & other ) = delete;
+};
+
+/* a trace, memory-mapped. only the header and index are read up front. */
+class TraceFile
+{
+public:
+  struct Block
+  {
+    const float * times;
+    const float * values;
+    uint32_t count;
+    float first_time;
+    float last_time;
+  };
+
+private:
+  int fd_;
+  size_t length_;
+  const char * data_;
+
+  std::vector<std::vector<Block>> series_;
+
+public:
+  TraceFile( const std::string & filename );
+  ~TraceFile();
+
+  size_t series_count( void ) const { return series_.size(); }
+  const std::vector<Block> & blocks( const size_t series ) const { return series_.at( series ); }
+
+  float start_time( void ) const;
+  float end_time( void ) const;
+  uint64_t sample_count( void ) const;
+
+  /* at least as many samples as any one series has within any span of
+     duration seconds (from the index alone, so to within a block or two) */
+  uint64_t densest( const double duration ) const;
+
+  /* forbid copy */
+  TraceFile( const TraceFile & other ) = delete;
+  TraceFile & operator=( const TraceFile & other ) = delete;
+};
+
+/* plays a trace into a Graph, a run of samples at a time straight out of the mapping */
+class TraceReplay
+{
+  const TraceFile & trace_;
+
+  /* next sample to play in each series */
+  struct Position
+  {
+    size_t block;
+    size_t index;
+  };
+
+  std::vector<Position> positions_;
+  uint64_t replayed_;
+
+public:
+  TraceReplay( const TraceFile & trace );
+
+  /* make the next sample of each series its first at or after t: O(log n) */
+  void seek( const float t );
+
+  /* add every sample up to and including time t to the graph */
+  void advance( const float t, Graph & graph );
+
+  /* the end of the earliest block still being played, to move through the trace a block at a time */
+  float next_block_end( void ) const;
+
+  bool finished( void ) const;
+  uint64_t replayed( void ) const { return replayed_; }
+};
+
+#endif /* TRACE_FILE_HH */
@@ -0,0 +1,272 @@
+#include <cstring>
+#include <cerrno>
+#include <cstdio>
+#include <algorithm>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "video_writer.hh"
+
+using namespace std;
+
+static int open_output( const string & filename )
+{
+  if ( filename == "-" ) {
+    return STDOUT_FILENO;
+  }
+
+  const int fd = open( filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+  if ( fd < 0 ) {
+    throw runtime_error( "cannot create " + filename + ": " + strerror( errno ) );
+  }
+  return fd;
+}
+
+VideoWriter::VideoWriter( const string & filename, const Format format, const unsigned int frame_rate,
+			  const size_t queue_capacity )
+  : fd_( open_output( filename ) ),
+    close_fd_( filename != "-" ),
+    format_( format ),
+    frame_rate_( frame_rate ),
+    queue_capacity_( queue_capacity ),
+    width_( 0 ),
+    height_( 0 ),
+    mutex_(),
+    frame_queued_(),
+    frame_taken_(),
+    queue_(),
+    spare_(),
+    writing_( 0 ),
+    finishing_( false ),
+    error_(),
+    frames_written_( 0 ),
+    thread_()
+{
+  if ( frame_rate_ == 0 or queue_capacity_ == 0 ) {
+    if ( close_fd_ ) {
+      close( fd_ );
+    }
+    throw runtime_error( "VideoWriter needs a frame rate and room for a frame" );
+  }
+
+  thread_ = thread( &VideoWriter::loop, this );
+}
+
+VideoWriter::~VideoWriter()
+{
+  stop();
+
+  if ( close_fd_ ) {
+    close( fd_ );
+  }
+}
+
+void VideoWriter::stop( void )
+{
+  {
+    unique_lock<mutex> lock( mutex_ );
+    finishing_ = true;
+  }
+  frame_queued_.notify_all();
+
+  if ( thread_.joinable() ) {
+    thread_.join();
+  }
+}
+
+void VideoWriter::write_all( const void * data, const size_t length )
+{
+  const char * p = static_cast<const char *>( data );
+  size_t remaining = length;
+
+  while ( remaining ) {
+    const ssize_t written = write( fd_, p, remaining );
+    if ( written < 0 ) {
+      if ( errno == EINTR ) {
+	continue;
+      }
+      throw runtime_error( string( "video write: " ) + strerror( errno ) );
+    }
+    p += written;
+    remaining -= written;
+  }
+}
+
+void VideoWriter::add_frame( const uint8_t * pixels, const unsigned int width, const unsigned int height,
+			     const size_t stride_bytes )
+{
+  unique_lock<mutex> lock( mutex_ );
+
+  if ( width_ == 0 ) {
+    width_ = width;
+    height_ = height;
+  } else if ( width != width_ or height != height_ ) {
+    throw runtime_error( "VideoWriter: frame size changed" );
+  }
+
+  frame_taken_.wait( lock, [&] () { return queue_.size() < queue_capacity_ or error_; } );
+  if ( error_ ) {
+    rethrow_exception( error_ );
+  }
+
+  vector<uint8_t> copy;
+  if ( not spare_.empty() ) {
+    copy = move( spare_.back() );
+    spare_.pop_back();
+  }
+
+  /* copy without the lock, so the encoder keeps going */
+  lock.unlock();
+
+  const size_t row_bytes = size_t( width ) * 4;
+  copy.resize( row_bytes * height );
+  for ( unsigned int y = 0; y < height; y++ ) {
+    memcpy( copy.data() + y * row_bytes, pixels + y * stride_bytes, row_bytes );
+  }
+
+  lock.lock();
+  queue_.push_back( Frame( { move( copy ), width, height } ) );
+  frame_queued_.notify_one();
+}
+
+void VideoWriter::finish( void )
+{
+  unique_lock<mutex> lock( mutex_ );
+  frame_taken_.wait( lock, [&] () { return queue_.empty() and writing_ == 0; } );
+
+  if ( error_ ) {
+    rethrow_exception( error_ );
+  }
+}
+
+uint64_t VideoWriter::frames_written( void )
+{
+  unique_lock<mutex> lock( mutex_ );
+  return frames_written_;
+}
+
+void VideoWriter::encode( const Frame & frame, vector<uint8_t> & out ) const
+{
+  const size_t width = frame.width, height = frame.height;
+
+  /* the top row of the picture, first */
+  const auto pixel = [&] ( const size_t x, const size_t y ) {
+    return frame.pixels.data() + ((height - 1 - y) * width + x) * 4;
+  };
+
+  if ( format_ == Format::RGB ) {
+    out.resize( width * height * 3 );
+    uint8_t * rgb = out.data();
+    for ( size_t y = 0; y < height; y++ ) {
+      for ( size_t x = 0; x < width; x++ ) {
+	const uint8_t * p = pixel( x, y );
+	*rgb++ = p[ 2 ];
+	*rgb++ = p[ 1 ];
+	*rgb++ = p[ 0 ];
+      }
+    }
+    return;
+  }
+
+  /* full-range BT.601 (which the header says with XCOLORRANGE=FULL; C420jpeg
+     only says where chroma is sited), chroma from each 2x2 block's mean color */
+  static const char frame_marker[] = "FRAME\n";
+  const size_t marker_length = sizeof( frame_marker ) - 1;
+  const size_t chroma_width = (width + 1) / 2, chroma_height = (height + 1) / 2;
+
+  out.resize( marker_length + width * height + 2 * chroma_width * chroma_height );
+  memcpy( out.data(), frame_marker, marker_length );
+
+  uint8_t * const luma = out.data() + marker_length;
+  uint8_t * const blue_difference = luma + width * height;
+  uint8_t * const red_difference = blue_difference + chroma_width * chroma_height;
+
+  for ( size_t y = 0; y < height; y++ ) {
+    for ( size_t x = 0; x < width; x++ ) {
+      const uint8_t * p = pixel( x, y );
+      luma[ y * width + x ] = (77 * p[ 2 ] + 150 * p[ 1 ] + 29 * p[ 0 ] + 128) >> 8;
+    }
+  }
+
+  for ( size_t cy = 0; cy < chroma_height; cy++ ) {
+    for ( size_t cx = 0; cx < chroma_width; cx++ ) {
+      /* an odd last row or column is averaged with itself */
+      const size_t xs[ 2 ] = { 2 * cx, min( 2 * cx + 1, width - 1 ) };
+      const size_t ys[ 2 ] = { 2 * cy, min( 2 * cy + 1, height - 1 ) };
+
+      int red = 0, green = 0, blue = 0;
+      for ( const size_t y : ys ) {
+	for ( const size_t x : xs ) {
+	  const uint8_t * p = pixel( x, y );
+	  red += p[ 2 ];
+	  green += p[ 1 ];
+	  blue += p[ 0 ];
+	}
+      }
+      red = (red + 2) / 4;
+      green = (green + 2) / 4;
+      blue = (blue + 2) / 4;
+
+      /* offset by 128 before shifting, so nothing negative is shifted */
+      const size_t i = cy * chroma_width + cx;
+      blue_difference[ i ] = min( 255, (-43 * red - 85 * green + 128 * blue + 32896) >> 8 );
+      red_difference[ i ] = min( 255, (128 * red - 107 * green - 21 * blue + 32896) >> 8 );
+    }
+  }
+}
+
+void VideoWriter::loop( void )
+{
+  vector<uint8_t> encoded;
+
+  unique_lock<mutex> lock( mutex_ );
+
+  while ( true ) {
+    frame_queued_.wait( lock, [&] () { return finishing_ or not queue_.empty(); } );
+    if ( queue_.empty() ) {
+      return;
+    }
+
+    Frame frame = move( queue_.front() );
+    queue_.pop_front();
+    writing_++;
+
+    const bool first = frames_written_ == 0;
+    const bool failed = static_cast<bool>( error_ );
+
+    lock.unlock();
+
+    /* after an error, frames are only taken off the queue */
+    exception_ptr error;
+    if ( not failed ) {
+      try {
+	if ( first and format_ == Format::Y4M ) {
+	  char header[ 128 ];
+	  const int length = snprintf( header, sizeof( header ),
+				       "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 C420jpeg XCOLORRANGE=FULL\n",
+				       frame.width, frame.height, frame_rate_ );
+	  write_all( header, length );
+	}
+
+	encode( frame, encoded );
+	write_all( encoded.data(), encoded.size() );
+      } catch ( ... ) {
+	error = current_exception();
+      }
+    }
+
+    lock.lock();
+
+    writing_--;
+    if ( error ) {
+      error_ = error;
+    } else if ( not failed ) {
+      frames_written_++;
+    }
+
+    spare_.push_back( move( frame.pixels ) );
+    frame_taken_.notify_all();
+  }
+}
@@ -0,0 +1,79 @@
+#ifndef VIDEO_WRITER_HH
+#define VIDEO_WRITER_HH
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <exception>
+#include <cstdint>
+
+/* writes frames of video to a file or pipe ("-" is standard output)
+   from its own thread, so converting and writing them overlaps with
+   drawing the next ones. either as Y4M (full-range 4:2:0, marked as
+   such, which most encoders read directly) or as bare RGB24 frames
+   with no header. frames queue up to a limit, after which add_frame()
+   waits: nothing is ever dropped. */
+class VideoWriter
+{
+public:
+  enum class Format { Y4M, RGB };
+
+private:
+  struct Frame
+  {
+    std::vector<uint8_t> pixels; /* BGRA, bottom row first, no padding */
+    unsigned int width, height;
+  };
+
+  int fd_;
+  bool close_fd_;
+  Format format_;
+  unsigned int frame_rate_;
+  size_t queue_capacity_;
+
+  /* set by the first frame; every other one must match */
+  unsigned int width_, height_;
+
+  std::mutex mutex_;
+  std::condition_variable frame_queued_;
+  std::condition_variable frame_taken_;
+  std::deque<Frame> queue_;
+  std::vector<std::vector<uint8_t>> spare_; /* written frames' storage, for reuse */
+  size_t writing_;
+  bool finishing_;
+  std::exception_ptr error_;
+  uint64_t frames_written_;
+
+  std::thread thread_;
+
+  void write_all( const void * data, const size_t length );
+  void encode( const Frame & frame, std::vector<uint8_t> & out ) const;
+  void loop( void );
+
+  /* stop the thread (after it writes what is queued) */
+  void stop( void );
+
+public:
+  VideoWriter( const std::string & filename, const Format format, const unsigned int frame_rate,
+	       const size_t queue_capacity = 8 );
+  ~VideoWriter();
+
+  /* queue a frame (BGRA rows of stride_bytes, bottom row first, as OpenGL reads
+     them); rethrows an error from writing an earlier one */
+  void add_frame( const uint8_t * pixels, const unsigned int width, const unsigned int height,
+		  const size_t stride_bytes );
+
+  /* wait until everything queued is written, and rethrow any error */
+  void finish( void );
+
+  uint64_t frames_written( void );
+
+  /* forbid copy */
+  VideoWriter( const VideoWriter & other ) = delete;
+  VideoWriter & operator=( const VideoWriter & other ) = delete;
+};
+
+#endif /* VIDEO_WRITER_HH */
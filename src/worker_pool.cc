@@ -0,0 +1,110 @@
+#include <stdexcept>
+
+#include "worker_pool.hh"
+
+using namespace std;
+
+WorkerPool::WorkerPool( const unsigned int thread_count )
+  : mutex_(),
+    job_available_(),
+    job_done_(),
+    task_( nullptr ),
+    part_count_( 0 ),
+    next_part_( 0 ),
+    parts_running_( 0 ),
+    generation_( 0 ),
+    error_(),
+    shutting_down_( false ),
+    workers_()
+{
+  if ( thread_count == 0 ) {
+    throw runtime_error( "WorkerPool needs at least one thread" );
+  }
+
+  for ( unsigned int i = 1; i < thread_count; i++ ) {
+    workers_.emplace_back( [this] () { work(); } );
+  }
+}
+
+WorkerPool::~WorkerPool()
+{
+  {
+    unique_lock<mutex> lock( mutex_ );
+    shutting_down_ = true;
+  }
+  job_available_.notify_all();
+
+  for ( auto & worker : workers_ ) {
+    worker.join();
+  }
+}
+
+void WorkerPool::run_parts( unique_lock<mutex> & lock )
+{
+  while ( next_part_ < part_count_ ) {
+    const size_t part = next_part_++;
+    parts_running_++;
+
+    lock.unlock();
+    exception_ptr error;
+    try {
+      (*task_)( part );
+    } catch ( ... ) {
+      error = current_exception();
+    }
+    lock.lock();
+
+    if ( error and not error_ ) {
+      error_ = error;
+    }
+
+    if ( --parts_running_ == 0 and next_part_ == part_count_ ) {
+      job_done_.notify_all();
+    }
+  }
+}
+
+void WorkerPool::work( void )
+{
+  unique_lock<mutex> lock( mutex_ );
+  uint64_t seen_generation = generation_;
+
+  while ( true ) {
+    job_available_.wait( lock, [&] () { return shutting_down_ or generation_ != seen_generation; } );
+
+    if ( shutting_down_ ) {
+      return;
+    }
+
+    seen_generation = generation_;
+    run_parts( lock );
+  }
+}
+
+void WorkerPool::run( const size_t part_count, const function<void( size_t )> & task )
+{
+  if ( workers_.empty() or part_count <= 1 ) {
+    for ( size_t i = 0; i < part_count; i++ ) {
+      task( i );
+    }
+    return;
+  }
+
+  unique_lock<mutex> lock( mutex_ );
+  task_ = &task;
+  part_count_ = part_count;
+  next_part_ = 0;
+  parts_running_ = 0;
+  error_ = nullptr;
+  generation_++;
+  job_available_.notify_all();
+
+  run_parts( lock );
+  job_done_.wait( lock, [&] () { return next_part_ == part_count_ and parts_running_ == 0; } );
+
+  task_ = nullptr;
+
+  if ( error_ ) {
+    rethrow_exception( error_ );
+  }
+}
@@ -0,0 +1,51 @@
+#ifndef WORKER_POOL_HH
+#define WORKER_POOL_HH
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+#include <cstdint>
+
+/* a fixed set of threads that run the parts of one job at a time.
+   the calling thread works on the job too, so a pool of one thread
+   has no workers and runs everything inline. */
+class WorkerPool
+{
+  std::mutex mutex_;
+  std::condition_variable job_available_;
+  std::condition_variable job_done_;
+
+  /* the current job: run task( i ) for every i below part_count */
+  const std::function<void( size_t )> * task_;
+  size_t part_count_;
+  size_t next_part_;
+  size_t parts_running_;
+  uint64_t generation_;
+  std::exception_ptr error_;
+  bool shutting_down_;
+
+  std::vector<std::thread> workers_;
+
+  /* take and run parts until none are left; called with the lock held */
+  void run_parts( std::unique_lock<std::mutex> & lock );
+  void work( void );
+
+public:
+  WorkerPool( const unsigned int thread_count );
+  ~WorkerPool();
+
+  unsigned int thread_count( void ) const { return workers_.size() + 1; }
+
+  /* run task( 0 ) ... task( part_count - 1 ) across the pool, and wait for
+     all of them; the first exception thrown by a part is rethrown here */
+  void run( const size_t part_count, const std::function<void( size_t )> & task );
+
+  /* forbid copy */
+  WorkerPool( const WorkerPool & other ) = delete;
+  WorkerPool & operator=( const WorkerPool & other ) = delete;
+};
+
+#endif /* WORKER_POOL_HH */